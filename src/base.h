@@ -58,6 +58,11 @@ namespace zutty
          return x == rhs.x && y == rhs.y;
       }
 
+      bool operator != (const Point& rhs) const
+      {
+         return ! operator == (rhs);
+      }
+
       bool operator <= (const Point& rhs) const
       {
          return operator < (rhs) || operator == (rhs);
@@ -96,6 +101,16 @@ namespace zutty
          return tl == br;
       }
 
+      bool operator == (const Rect& rhs) const
+      {
+         return tl == rhs.tl && br == rhs.br && rectangular == rhs.rectangular;
+      }
+
+      bool operator != (const Rect& rhs) const
+      {
+         return ! operator == (rhs);
+      }
+
       Point mid () const
       {
          return Point ((tl.x + br.x) / 2, (tl.y + br.y) / 2);
@@ -36,7 +36,7 @@ namespace zutty
 namespace base64
 {
 
-   static std::string
+   inline std::string
    encode (const std::string& in)
    {
       std::string out;
@@ -59,7 +59,7 @@ namespace base64
       return out;
    }
 
-   static std::string
+   inline std::string
    decode (const std::string& in)
    {
       std::string out;
@@ -16,6 +16,8 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <sstream>
+#include <string.h>
 
 namespace
 {
@@ -27,17 +29,19 @@ layout (binding = 1) uniform lowp sampler2DArray atlas;
 layout (binding = 2) uniform lowp sampler2D atlasMap;
 layout (binding = 3) uniform lowp sampler2DArray atlas_dw;
 layout (binding = 4) uniform lowp sampler2D atlasMap_dw;
-uniform lowp ivec2 glyphPixels;
+const ivec2 glyphPixels = ivec2 (GLYPH_PX, GLYPH_PY);
 uniform lowp ivec2 sizeChars;
 uniform lowp ivec3 cursorColor;
 uniform lowp ivec4 cursorPos; // .xy: current; .zw: previous
 uniform lowp int cursorStyle;
 uniform lowp ivec4 selectRect;
 uniform lowp int selectRectMode;
+uniform lowp ivec4 selectArea; // .xy: top left; .zw: bottom right (exclusive)
 uniform highp ivec2 selectDamage;
 uniform lowp int deltaFrame;
-uniform lowp int showWraps;
-uniform lowp int hasDoubleWidth;
+uniform int rowOffset; // first row of the dispatch
+const int showWraps = SHOW_WRAPS;
+const int hasDoubleWidth = HAS_DOUBLE_WIDTH;
 
 struct Cell
 {
@@ -51,20 +55,44 @@ layout (std430, binding = 0) buffer CharVideoMem
    Cell cells[];
 } vmem;
 
+#if SHOW_DAMAGE
+// Damage overlay: the heat of each cell is set when it is rendered due to
+// damage, and decreases on each frame after that, with the cell rendered
+// again with a fading tint. Bit 8 marks damage by a full redraw.
+layout (std430, binding = 1) buffer DamageHeat
+{
+   highp uint heat[];
+} dmg;
+const uint fadeFrames = uint (DAMAGE_FADE_FRAMES);
+#endif
+
 void main ()
 {
-   ivec2 charPos = ivec2 (gl_GlobalInvocationID.xy);
+   ivec2 charPos = ivec2 (gl_GlobalInvocationID.xy) + ivec2 (0, rowOffset);
    int idx = sizeChars.x * charPos.y + charPos.x;
    Cell cell = vmem.cells[idx];
 
+   bool damaged = true;
    if (deltaFrame == 1)
    {
       uint dirty = bitfieldExtract (cell.charData, 23, 1);
-      if (dirty == 0u &&
-          charPos != cursorPos.xy && charPos != cursorPos.zw &&
-          (idx < selectDamage.x || idx >= selectDamage.y))
-         return;
+      damaged = (dirty == 1u ||
+                 charPos == cursorPos.xy || charPos == cursorPos.zw ||
+                 (idx >= selectDamage.x && idx < selectDamage.y));
    }
+#if SHOW_DAMAGE
+   uint heat = dmg.heat[idx];
+   if (damaged)
+      heat = fadeFrames | (deltaFrame == 0 ? 256u : 0u);
+   else if ((heat & 255u) > 0u)
+      heat -= 1u;
+   else
+      return;
+   dmg.heat[idx] = heat;
+#else
+   if (!damaged)
+      return;
+#endif
    vmem.cells[idx].charData = bitfieldInsert (cell.charData, 0u, 23, 1);
 
    ivec2 charCode =
@@ -106,17 +134,18 @@ void main ()
 
    vec3 crColor = vec3 (cursorColor) / 255.0;
 
+   bool selected;
    if (selectRectMode == 1)
-   {
-      if (charPos.y >= selectRect.y && charPos.y <= selectRect.w &&
-          charPos.x >= selectRect.x && charPos.x < selectRect.z)
-         inverse ^= 1u;
-   }
-   else if ((charPos.y > selectRect.y && charPos.y < selectRect.w) ||
-       (charPos.y == selectRect.y && charPos.x >= selectRect.x &&
-        (charPos.y < selectRect.w || charPos.x < selectRect.z)) ||
-       (charPos.y == selectRect.w && charPos.x < selectRect.z &&
-        (charPos.y > selectRect.y || charPos.x > selectRect.x)))
+      selected = (charPos.y >= selectRect.y && charPos.y <= selectRect.w &&
+                  charPos.x >= selectRect.x && charPos.x < selectRect.z);
+   else
+      selected = ((charPos.y > selectRect.y && charPos.y < selectRect.w) ||
+                  (charPos.y == selectRect.y && charPos.x >= selectRect.x &&
+                   (charPos.y < selectRect.w || charPos.x < selectRect.z)) ||
+                  (charPos.y == selectRect.w && charPos.x < selectRect.z &&
+                   (charPos.y > selectRect.y || charPos.x > selectRect.x)));
+   if (selected && all (greaterThanEqual (charPos, selectArea.xy)) &&
+       all (lessThan (charPos, selectArea.zw)))
       inverse ^= 1u;
 
    if (inverse == 1u)
@@ -135,11 +164,32 @@ void main ()
       bgColor = crColor;
    }
 
+#if SHOW_DAMAGE
+   // Red: full redraw; green: delta frame
+   vec3 tint = (heat & 256u) != 0u ? vec3 (1.0, 0.0, 0.0)
+                                   : vec3 (0.0, 1.0, 0.0);
+   float tintLevel = 0.5 * float (heat & 255u) / float (fadeFrames);
+   fgColor = mix (fgColor, tint, tintLevel);
+   bgColor = mix (bgColor, tint, tintLevel);
+#endif
+
    ivec2 srcGlyphPixels = glyphPixels;
    if (dwidth == 1u)
       srcGlyphPixels = ivec2 (2, 1) * glyphPixels;
 
-   if (dwidth == 0u)
+   if (atlasPos == ivec2 (0, 0) && (dwidth == 0u || hasDoubleWidth == 1))
+   {  // blank glyph -- fill with background, no need to sample the atlas
+      vec4 pixel = vec4 (bgColor, 1.0);
+      for (int j = 0; j < srcGlyphPixels.x; j++)
+      {
+         for (int k = 0; k < srcGlyphPixels.y; k++)
+         {
+            ivec2 pxCoords = charPos * glyphPixels + ivec2 (j, k);
+            imageStore (imgOut, pxCoords, pixel);
+         }
+      }
+   }
+   else if (dwidth == 0u)
    {  // render regular cell
       for (int j = 0; j < glyphPixels.x; j++)
       {
@@ -262,12 +312,279 @@ void main ()
 )";
 
 
+   /* Instanced quads (GLES 3.0): one quad per cell, with the cell data fed
+    * from the same buffer as instanced vertex attributes. The quad is
+    * rasterized directly into the window, so there is no output image and
+    * no copy pass. The logic mirrors the compute shader above.
+    */
+   static const char *quadsVertexShaderSource = R"(#version 300 es
+
+precision highp float;
+precision highp int;
+
+in highp uvec3 cell;     // charData, fg, bg
+in highp uvec3 nextCell; // the cell to the right, for double-width check
+
+uniform lowp sampler2D atlasMap;
+uniform lowp sampler2D atlasMap_dw;
+const ivec2 glyphPixels = ivec2 (GLYPH_PX, GLYPH_PY);
+uniform ivec2 sizeChars;
+uniform vec2 viewPixels;
+uniform ivec3 cursorColor;
+uniform ivec4 cursorPos; // .xy: current; .zw: previous
+uniform int cursorStyle;
+uniform ivec4 selectRect;
+uniform int selectRectMode;
+uniform ivec4 selectArea; // .xy: top left; .zw: bottom right (exclusive)
+uniform int rowOffset; // first row drawn
+const int hasDoubleWidth = HAS_DOUBLE_WIDTH;
+#if SHOW_DAMAGE
+uniform int deltaFrame;
+#endif
+
+out vec2 glyphCoord; // pixel offset inside the glyph
+flat out ivec2 atlasOrigin;
+flat out ivec2 srcGlyphPixels;
+flat out int fontIdx;
+flat out int flags; // 1: blank; 2: empty box; 4: underline; 8: wrap;
+                    // 16: hollow cursor; 32: double-width glyph
+flat out vec3 fgColor;
+flat out vec3 bgColor;
+flat out vec3 crColor;
+
+// bitfieldExtract () is not available before GLSL ES 3.10
+uint bits (uint value, int offset, int count)
+{
+   return (value >> uint (offset)) & ((1u << uint (count)) - 1u);
+}
+
+void main ()
+{
+   int idx = gl_InstanceID + rowOffset * sizeChars.x;
+   ivec2 charPos = ivec2 (idx % sizeChars.x, idx / sizeChars.x);
+   uint charData = cell.x;
+
+   uint dwidth = bits (charData, 16, 1);
+   uint dwidth_cont = bits (charData, 17, 1);
+   if (dwidth_cont == 1u) // double-width cell continuation - drawn by left half
+   {
+      gl_Position = vec4 (2.0, 2.0, 2.0, 1.0); // degenerate, culled
+      return;
+   }
+
+   if (dwidth == 1u && charPos.x < sizeChars.x - 1)
+   {
+      // check validity (dwidth_cont marker in the cell to the right)
+      if (bits (nextCell.x, 17, 1) != 1u)
+         dwidth = 0u;
+   }
+
+   ivec2 charCode = ivec2 (bits (charData, 0, 8),
+                           bits (charData, 8, 8));
+   fontIdx = 0;
+   if (dwidth == 0u)
+      fontIdx = int (bits (charData, 18, 2));
+   uint inverse = bits (charData, 21, 1);
+
+   ivec2 atlasPos;
+   if (dwidth == 0u)
+      atlasPos = ivec2 (vec2 (256) * texelFetch (atlasMap, charCode, 0).zw);
+   else
+      atlasPos = ivec2 (vec2 (256) * texelFetch (atlasMap_dw, charCode, 0).zw);
+
+   fgColor = vec3 (float (bits (cell.y, 0, 8)),
+                   float (bits (cell.y, 8, 8)),
+                   float (bits (cell.y, 16, 8))) / 255.0;
+
+   bgColor = vec3 (float (bits (cell.z, 0, 8)),
+                   float (bits (cell.z, 8, 8)),
+                   float (bits (cell.z, 16, 8))) / 255.0;
+
+   crColor = vec3 (cursorColor) / 255.0;
+
+   bool selected;
+   if (selectRectMode == 1)
+      selected = (charPos.y >= selectRect.y && charPos.y <= selectRect.w &&
+                  charPos.x >= selectRect.x && charPos.x < selectRect.z);
+   else
+      selected = ((charPos.y > selectRect.y && charPos.y < selectRect.w) ||
+                  (charPos.y == selectRect.y && charPos.x >= selectRect.x &&
+                   (charPos.y < selectRect.w || charPos.x < selectRect.z)) ||
+                  (charPos.y == selectRect.w && charPos.x < selectRect.z &&
+                   (charPos.y > selectRect.y || charPos.x > selectRect.x)));
+   if (selected && all (greaterThanEqual (charPos, selectArea.xy)) &&
+       all (lessThan (charPos, selectArea.zw)))
+      inverse ^= 1u;
+
+   if (inverse == 1u)
+   {
+      vec3 tmp = fgColor;
+      fgColor = bgColor;
+      bgColor = tmp;
+   }
+   if (crColor == bgColor)
+   {
+      crColor = vec3 (1.0) - crColor;
+   }
+   if (charPos == cursorPos.xy && cursorStyle == 1)
+   {
+      fgColor = bgColor;
+      bgColor = crColor;
+   }
+
+#if SHOW_DAMAGE
+   // Damage overlay: unlike the compute shader, quads keep no state
+   // across frames, so only the cells damaged in this frame are tinted.
+   if (deltaFrame == 0 || bits (charData, 23, 1) == 1u ||
+       charPos == cursorPos.xy || charPos == cursorPos.zw)
+   {
+      vec3 tint = deltaFrame == 0 ? vec3 (1.0, 0.0, 0.0)
+                                  : vec3 (0.0, 1.0, 0.0);
+      fgColor = mix (fgColor, tint, 0.5);
+      bgColor = mix (bgColor, tint, 0.5);
+   }
+#endif
+
+   srcGlyphPixels = glyphPixels;
+   if (dwidth == 1u)
+      srcGlyphPixels = ivec2 (2, 1) * glyphPixels;
+   atlasOrigin = atlasPos * srcGlyphPixels;
+
+   flags = 0;
+   if (dwidth == 1u && hasDoubleWidth == 0)
+      flags |= 2;
+   else if (atlasPos == ivec2 (0, 0))
+      flags |= 1;
+   else if (dwidth == 1u)
+      flags |= 32;
+   if (bits (charData, 20, 1) == 1u)
+      flags |= 4;
+   if (bits (charData, 22, 1) == 1u)
+      flags |= 8;
+   if (charPos == cursorPos.xy && cursorStyle == 2)
+      flags |= 16;
+
+   // Triangle strip: (0,0), (1,0), (0,1), (1,1); origin at top left
+   ivec2 corner = ivec2 (gl_VertexID & 1, gl_VertexID >> 1);
+   glyphCoord = vec2 (corner * srcGlyphPixels);
+   vec2 pos = vec2 (charPos * glyphPixels) + glyphCoord;
+   gl_Position = vec4 (vec2 (-1.0, 1.0) + vec2 (2.0, -2.0) * pos / viewPixels,
+                       0.0, 1.0);
+}
+)";
+
+   static const char *quadsFragmentShaderSource = R"(#version 300 es
+
+precision highp float;
+precision highp int;
+
+uniform lowp sampler2DArray atlas;
+uniform lowp sampler2DArray atlas_dw;
+const int showWraps = SHOW_WRAPS;
+
+in vec2 glyphCoord;
+flat in ivec2 atlasOrigin;
+flat in ivec2 srcGlyphPixels;
+flat in int fontIdx;
+flat in int flags;
+flat in vec3 fgColor;
+flat in vec3 bgColor;
+flat in vec3 crColor;
+
+layout (location = 0) out lowp vec4 outColor;
+
+void main ()
+{
+   ivec2 p = ivec2 (glyphCoord);
+   ivec2 last = srcGlyphPixels - ivec2 (1);
+
+   if ((flags & 16) != 0 &&
+       (p.x == 0 || p.y == 0 || p.x == last.x || p.y == last.y))
+   {
+      outColor = vec4 (crColor, 1.0);
+      return;
+   }
+   if ((flags & 4) != 0 && p.y == last.y)
+   {
+      outColor = vec4 (fgColor, 1.0);
+      return;
+   }
+   if (showWraps == 1 && (flags & 8) != 0 && p.x == last.x && p.y % 2 == 0)
+   {
+      outColor = vec4 (fgColor, 1.0);
+      return;
+   }
+
+   float lumi = 0.0;
+   if ((flags & 2) != 0)
+   {  // no double-width font -- draw an empty box
+      if ((0 < p.x && p.x < last.x) && (0 < p.y && p.y < last.y) &&
+          (p.x == 1 || p.x == last.x - 1 || p.y == 1 || p.y == last.y - 1))
+         lumi = 0.7;
+   }
+   else if ((flags & 32) != 0)
+   {  // double-width cell
+      lumi = texelFetch (atlas_dw, ivec3 (atlasOrigin + p, 0), 0).r;
+   }
+   else if ((flags & 1) == 0)
+   {  // regular cell (blank glyphs are just background)
+      lumi = texelFetch (atlas, ivec3 (atlasOrigin + p, fontIdx), 0).r;
+   }
+   outColor = vec4 (fgColor * lumi + bgColor * (1.0 - lumi), 1.0);
+}
+)";
+
+   /* Images (see image.h) are drawn on top of the cells as textured
+    * quads, one draw call per placement; corners come from gl_VertexID.
+    */
+   static const char *imageVertexShaderSource = R"(#version 300 es
+
+uniform vec2 viewPixels;
+uniform vec4 dstRect; // x, y, width, height in view pixels
+uniform vec4 srcRect; // the same in texture coordinates
+
+out vec2 texCoord;
+
+void main ()
+{
+   vec2 corner = vec2 (float (gl_VertexID & 1), float (gl_VertexID >> 1));
+   texCoord = srcRect.xy + corner * srcRect.zw;
+   vec2 pos = dstRect.xy + corner * dstRect.zw;
+   gl_Position = vec4 (vec2 (-1.0, 1.0) + vec2 (2.0, -2.0) * pos / viewPixels,
+                       0.0, 1.0);
+}
+)";
+
+   static const char *imageFragmentShaderSource = R"(#version 300 es
+
+precision mediump float;
+
+in vec2 texCoord;
+
+uniform lowp sampler2D image;
+
+layout (location = 0) out lowp vec4 outColor;
+
+void main ()
+{
+   outColor = texture (image, texCoord);
+}
+)";
+
+   /* Compile a shader, specialized by inserting defines right after the
+    * #version line, so that the compiler can fold constants, unroll the
+    * glyph pixel loops and drop unused branches.
+    */
    GLuint
-   createShader (GLuint type, const char* src, const char* name)
+   createShader (GLuint type, const char* src, const std::string& defines,
+                 const char* name)
    {
       GLint stat;
       GLuint shader = glCreateShader (type);
-      glShaderSource (shader, 1, &src, nullptr);
+      const char* eol = strchr (src, '\n') + 1;
+      const char* srcs [] = { src, defines.c_str (), eol };
+      const GLint lens [] = { (GLint)(eol - src), -1, -1 };
+      glShaderSource (shader, 3, srcs, lens);
       glCompileShader (shader);
       glGetShaderiv (shader, GL_COMPILE_STATUS, &stat);
       if (!stat) {
@@ -329,63 +646,51 @@ void main ()
    }
 
    void
-   setupAtlasMappingTexture (const zutty::Font& fnt,
+   setupAtlasMappingTexture (const std::vector <zutty::Font::AtlasPos>& atlasMap,
                              GLuint target, GLuint& texture)
    {
-      auto atlasMap = std::vector <uint8_t> ();
-      atlasMap.resize (2 * 256 * 256, 0);
-
-      // Pre-fill the mapping texture with references to "missing glyph"
-      // and "replacement character" glyphs, if available in the font atlas.
-      const auto itEnd = fnt.getAtlasMap ().end ();
-
-      zutty::Font::AtlasPos apRC {};
-      {
-         auto rcIt =
-            fnt.getAtlasMap ().find (zutty::Unicode_Replacement_Character);
-         if (rcIt != itEnd)
-            apRC = rcIt->second;
-      }
-
-      zutty::Font::AtlasPos apMG {};
-      {
-         auto mgIt = fnt.getAtlasMap ().find (zutty::Missing_Glyph_Marker);
-         if (mgIt != itEnd)
-            apMG = mgIt->second;
-      }
-
-      for (int k = 0; k < 256 * 256; ++k)
-      {
-         const auto& apos = ((k >= 0xd800 && k < 0xe000) || k >= 0xfffe)
-                          ? apRC
-                          : apMG;
-         atlasMap [2 * k] = apos.x;
-         atlasMap [2 * k + 1] = apos.y;
-      }
-
-      // Fill the mapping texture with supported characters
-      for (auto it = fnt.getAtlasMap ().begin (); it != itEnd; ++it)
-      {
-         atlasMap [2 * it->first] = it->second.x;
-         atlasMap [2 * it->first + 1] = it->second.y;
-      }
+      static_assert (sizeof (zutty::Font::AtlasPos) == 2,
+                     "AtlasPos must map to a LUMINANCE_ALPHA texel");
       setupTexture (target, GL_TEXTURE_2D, texture);
       glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, 256, 256, 0,
                    GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, atlasMap.data ());
    }
 
+   /* Round n up to a size class. Classes grow geometrically, four per
+    * doubling, so that an allocation can be reused while the window is
+    * resized within it, at a cost of at most 25% unused headroom.
+    */
+   uint32_t
+   sizeClass (uint32_t n)
+   {
+      uint32_t step = 1;
+      while ((n >> 3) >= step)
+         step <<= 1;
+      return (n + step - 1) / step * step;
+   }
+
+   // Whether an allocation for capacity items can be reused for n items
+   bool
+   withinCapacity (uint32_t n, uint32_t capacity)
+   {
+      // Give back the memory after shrinking to less than half of it
+      return n <= capacity && n > capacity / 2;
+   }
+
    template <typename T> void
-   setupStorageBuffer (GLuint index, GLuint& buffer, uint32_t n_items)
+   setupStorageBuffer (GLenum target, GLuint index, GLuint& buffer,
+                       uint32_t n_items)
    {
       if (buffer)
       {
          glDeleteBuffers (1, &buffer);
       }
       glGenBuffers (1, &buffer);
-      glBindBuffer (GL_SHADER_STORAGE_BUFFER, buffer);
-      glBindBufferBase (GL_SHADER_STORAGE_BUFFER, index, buffer);
+      glBindBuffer (target, buffer);
+      if (target == GL_SHADER_STORAGE_BUFFER)
+         glBindBufferBase (target, index, buffer);
       std::size_t size = sizeof (T) * n_items;
-      glBufferData (GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+      glBufferData (target, size, nullptr, GL_DYNAMIC_DRAW);
    }
 
 } // namespace
@@ -396,12 +701,25 @@ namespace zutty
       : px (fontpk->getPx ())
       , py (fontpk->getPy ())
    {
+      GLint glMajor = 0, glMinor = 0;
+      glGetIntegerv (GL_MAJOR_VERSION, &glMajor);
+      glGetIntegerv (GL_MINOR_VERSION, &glMinor);
+      useCompute = opts.compute &&
+                   (glMajor > 3 || (glMajor == 3 && glMinor >= 1));
+      logI << "OpenGL ES " << glMajor << "." << glMinor << ", rendering with "
+           << (useCompute ? "compute shader" : "instanced quads") << std::endl;
+
+      hasDoubleWidth = fontpk->hasDoubleWidth ();
       createShaders ();
 
-      /*
-       * Setup draw program
-       */
-      glUseProgram (P_draw);
+      if (opts.gpuTimers)
+      {
+         if (GpuTimer::isSupported ())
+            gpuTimer = std::make_unique <GpuTimer> ();
+         else
+            logW << "GL_EXT_disjoint_timer_query not supported, "
+                 << "not measuring GPU time" << std::endl;
+      }
 
       glDisable (GL_CULL_FACE);
       glDisable (GL_DEPTH_TEST);
@@ -409,31 +727,45 @@ namespace zutty
       glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
       glCheckError ();
 
-      static const GLfloat verts[4][2] = {
-         { -1,  1 },
-         {  1,  1 },
-         { -1, -1 },
-         {  1, -1 }
-      };
-      static const GLfloat texCoords[4][2] = {
-         { 0, 0 },
-         { 1, 0 },
-         { 0, 1 },
-         { 1, 1 }
-      };
-
-      glVertexAttribPointer (A_pos, 2, GL_FLOAT, GL_FALSE, 0, verts);
-      glVertexAttribPointer (A_vertexTexCoord, 2, GL_FLOAT, GL_FALSE, 0,
-                             texCoords);
-      glCheckError ();
+      /*
+       * Setup draw program
+       */
+      if (useCompute)
+      {
+         glUseProgram (P_draw);
+
+         static const GLfloat verts[4][2] = {
+            { -1,  1 },
+            {  1,  1 },
+            { -1, -1 },
+            {  1, -1 }
+         };
+         static const GLfloat texCoords[4][2] = {
+            { 0, 0 },
+            { 1, 0 },
+            { 0, 1 },
+            { 1, 1 }
+         };
+
+         glVertexAttribPointer (A_pos, 2, GL_FLOAT, GL_FALSE, 0, verts);
+         glVertexAttribPointer (A_vertexTexCoord, 2, GL_FLOAT, GL_FALSE, 0,
+                                texCoords);
+         glCheckError ();
+      }
 
       /*
-       * Setup compute program
+       * Setup cells program
        */
-      glUseProgram (P_compute);
-      glUniform2i (compU_glyphPixels, px, py);
-      glUniform2i (compU_sizeChars, nCols, nRows);
-      glUniform1i (compU_showWraps, opts.showWraps ? 1 : 0);
+      glUseProgram (P_cells);
+      if (!useCompute)
+      {
+         // No layout bindings in GLES 3.0 shaders; use the same units
+         glUniform1i (glGetUniformLocation (P_cells, "atlas"), 1);
+         glUniform1i (glGetUniformLocation (P_cells, "atlasMap"), 2);
+         glUniform1i (glGetUniformLocation (P_cells, "atlas_dw"), 3);
+         glUniform1i (glGetUniformLocation (P_cells, "atlasMap_dw"), 4);
+      }
+      glUniform2i (cellsU_sizeChars, nCols, nRows);
 
       // Setup atlas texture
       setupTexture (GL_TEXTURE1, GL_TEXTURE_2D_ARRAY, T_atlas);
@@ -465,13 +797,12 @@ namespace zutty
       else
          setupAtlasTexture (fontpk->getRegular (), 3);
 
-      setupAtlasMappingTexture (reg, GL_TEXTURE2, T_atlasMap);
+      setupAtlasMappingTexture (fontpk->getAtlasLookup (false),
+                                GL_TEXTURE2, T_atlasMap);
 
       // Setup atlas texture for double-width characters
-      if (fontpk->hasDoubleWidth ())
+      if (hasDoubleWidth)
       {
-         hasDoubleWidth = true;
-
          setupTexture (GL_TEXTURE3, GL_TEXTURE_2D_ARRAY, T_atlas_dw);
          const Font& dw = fontpk->getDoubleWidth ();
          glTexStorage3D (GL_TEXTURE_2D_ARRAY, 1, GL_R8,
@@ -481,9 +812,16 @@ namespace zutty
          glCheckError ();
 
          setupAtlasTexture (dw, 0);
-         setupAtlasMappingTexture (dw, GL_TEXTURE3, T_atlasMap_dw);
+         setupAtlasMappingTexture (fontpk->getAtlasLookup (true),
+                                   GL_TEXTURE3, T_atlasMap_dw);
       }
-      glUniform1i (compU_hasDoubleWidth, hasDoubleWidth ? 1 : 0);
+
+      // If the back buffer survives eglSwapBuffers, draw only damaged areas
+      EGLint swapBehavior = 0;
+      eglQuerySurface (eglGetCurrentDisplay (), eglGetCurrentSurface (EGL_DRAW),
+                       EGL_SWAP_BEHAVIOR, &swapBehavior);
+      bufferPreserved = (swapBehavior == EGL_BUFFER_PRESERVED);
+      logT << "Back buffer preserved: " << bufferPreserved << std::endl;
 
       // Now that it's all loaded into GL, no need to keep font data in-memory
       fontpk->releaseFonts ();
@@ -491,6 +829,15 @@ namespace zutty
 
    CharVdev::~CharVdev ()
    {
+      if (gpuTimer)
+      {
+         gpuTimer->flush ();
+         std::cout << "\nGPU time per frame (p50/p90/p99 of the last "
+                   << "frames):\n";
+         for (const auto& line: gpuTimer->summary ())
+            std::cout << line << "\n";
+         std::cout << std::flush;
+      }
    }
 
    bool
@@ -515,21 +862,58 @@ namespace zutty
       glViewport (opts.border, pxHeight - viewHeight - opts.border,
                   viewWidth, viewHeight);
 
-      glUseProgram (P_draw);
+      if (useCompute)
+      {
+         glUseProgram (P_draw);
+
+         glUniform2f (drawU_viewPixels, (GLfloat)viewWidth, (GLfloat)viewHeight);
+      }
 
-      glUniform2f (drawU_viewPixels, (GLfloat)viewWidth, (GLfloat)viewHeight);
+      glUseProgram (P_image);
+      glUniform2f (imageU_viewPixels, (GLfloat)viewWidth, (GLfloat)viewHeight);
 
-      glUseProgram (P_compute);
+      glUseProgram (P_cells);
 
-      glUniform2i (compU_sizeChars, nCols, nRows);
+      glUniform2i (cellsU_sizeChars, nCols, nRows);
+      glUniform2f (cellsU_viewPixels, (GLfloat)viewWidth, (GLfloat)viewHeight);
 
-      setupTexture (GL_TEXTURE0, GL_TEXTURE_2D, T_output);
-      glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA32F, viewWidth, viewHeight);
-      glBindImageTexture (0, T_output, 0, GL_FALSE, 0, GL_WRITE_ONLY,
-                          GL_RGBA32F);
-      glCheckError ();
+      /* The output image and the cell buffer are allocated with headroom
+       * and kept as long as the window fits, so that drag-resizing mostly
+       * changes only the viewport and the uniforms above. Only the top
+       * left viewWidth x viewHeight of the image is ever used.
+       */
+      if (useCompute && !(withinCapacity (viewWidth, outputWidth) &&
+                          withinCapacity (viewHeight, outputHeight)))
+      {
+         outputWidth = sizeClass (viewWidth);
+         outputHeight = sizeClass (viewHeight);
+         logT << "Allocate output image " << outputWidth << " x "
+              << outputHeight << std::endl;
+         setupTexture (GL_TEXTURE0, GL_TEXTURE_2D, T_output);
+         glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA32F,
+                         outputWidth, outputHeight);
+         glBindImageTexture (0, T_output, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                             GL_RGBA32F);
+         glCheckError ();
+      }
 
-      setupStorageBuffer <Cell> (0, B_text, nRows * nCols);
+      // One spare cell at the end for the nextCell attribute of quads
+      const uint32_t nCells = nRows * nCols + 1;
+      if (!withinCapacity (nCells, bufferCells))
+      {
+         bufferCells = sizeClass (nCells);
+         logT << "Allocate cell buffer for " << bufferCells << " cells"
+              << std::endl;
+         setupStorageBuffer <Cell> (bufferTarget (), 0, B_text, bufferCells);
+         if (!useCompute)
+            setupCellAttributes (0);
+         // Left uninitialized, as the next frame is a full redraw,
+         // which sets the heat of all cells
+         if (useCompute && opts.showDamage)
+            setupStorageBuffer <uint32_t> (GL_SHADER_STORAGE_BUFFER, 1,
+                                           B_damage, bufferCells);
+      }
+      fullDamage = true;
 
       return true;
    }
@@ -540,45 +924,116 @@ namespace zutty
       static uint16_t prevPosX = 0;
       static uint16_t prevPosY = 0;
 
-      glUseProgram (P_compute);
-      glUniform3i (compU_cursorColor,
+      glUseProgram (P_cells);
+      glUniform3i (cellsU_cursorColor,
                    cursor.color.red, cursor.color.green, cursor.color.blue);
-      glUniform4i (compU_cursorPos, cursor.posX, cursor.posY, prevPosX, prevPosY);
+      glUniform4i (cellsU_cursorPos, cursor.posX, cursor.posY, prevPosX, prevPosY);
+      // cover the right half of a double-width character, too
+      addDamage (Rect (cursor.posX, cursor.posY, cursor.posX + 2, cursor.posY));
+      addDamage (Rect (prevPosX, prevPosY, prevPosX + 2, prevPosY));
       prevPosX = cursor.posX;
       prevPosY = cursor.posY;
-      glUniform1i (compU_cursorStyle, static_cast <uint8_t> (cursor.style));
+      glUniform1i (cellsU_cursorStyle, static_cast <uint8_t> (cursor.style));
    }
 
    void
-   CharVdev::setSelection (const Rect& sel)
+   CharVdev::setSelection (const Rect& sel, const Rect& area)
    {
       static Rect prev;
       Rect damage (std::min (sel.tl, prev.tl), std::max (sel.br, prev.br));
       uint32_t damageStart = nCols * damage.tl.y + damage.tl.x;
       uint32_t damageEnd = nCols * damage.br.y + damage.br.x + 1;
+      if (sel.tl != prev.tl || sel.br != prev.br ||
+          sel.rectangular != prev.rectangular)
+         addDamage (Rect (0, damage.tl.y, nCols, damage.br.y));
       prev = sel;
 
-      glUseProgram (P_compute);
-      glUniform4i (compU_selectRect, sel.tl.x, sel.tl.y, sel.br.x, sel.br.y);
-      glUniform1i (compU_selectRectMode, static_cast <int> (sel.rectangular));
-      glUniform2i (compU_selectDamage, damageStart, damageEnd);
+      glUseProgram (P_cells);
+      glUniform4i (cellsU_selectRect, sel.tl.x, sel.tl.y, sel.br.x, sel.br.y);
+      glUniform1i (cellsU_selectRectMode, static_cast <int> (sel.rectangular));
+      if (area.null ())
+         glUniform4i (cellsU_selectArea, 0, 0, nCols, nRows);
+      else
+         glUniform4i (cellsU_selectArea, area.tl.x, area.tl.y,
+                      area.br.x, area.br.y);
+      glUniform2i (cellsU_selectDamage, damageStart, damageEnd);
    }
 
    void
    CharVdev::setDeltaFrame (bool delta)
    {
-      glUseProgram (P_compute);
-      glUniform1i (compU_deltaFrame, delta ? 1 : 0);
+      glUseProgram (P_cells);
+      glUniform1i (cellsU_deltaFrame, delta ? 1 : 0);
+      if (!delta)
+         fullDamage = true;
+   }
+
+   void
+   CharVdev::setImages (const std::vector <ImagePlacement>& images_)
+   {
+      // Damage the cells under placements appearing, moving or disappearing
+      for (const auto& p: images)
+         if (std::find (images_.begin (), images_.end (), p) == images_.end ())
+            addDamage (p.cellRect ());
+      for (const auto& p: images_)
+         if (std::find (images.begin (), images.end (), p) == images.end ())
+            addDamage (p.cellRect ());
+      images = images_;
+
+      // Release the textures of images no longer shown
+      for (auto it = imageTextures.begin (); it != imageTextures.end (); )
+      {
+         if (std::none_of (images.begin (), images.end (),
+                           [&] (const ImagePlacement& p)
+                           { return p.image.get () == it->first; }))
+         {
+            glDeleteTextures (1, &it->second);
+            it = imageTextures.erase (it);
+         }
+         else
+            ++it;
+      }
    }
 
    void
+   CharVdev::addDamage (const Rect& cells)
+   {
+      if (cells.null ())
+         return;
+
+      Rect r (std::max (0, cells.tl.x), std::max (0, cells.tl.y),
+              std::min ((int)nCols, cells.br.x),
+              std::min (nRows - 1, cells.br.y));
+      if (r.tl.x >= r.br.x || r.tl.y > r.br.y)
+         return;
+
+      if (damage.null ())
+      {
+         damage = r;
+         return;
+      }
+      damage.tl.x = std::min (damage.tl.x, r.tl.x);
+      damage.tl.y = std::min (damage.tl.y, r.tl.y);
+      damage.br.x = std::max (damage.br.x, r.br.x);
+      damage.br.y = std::max (damage.br.y, r.br.y);
+   }
+
+   Rect
    CharVdev::draw ()
    {
       assert (cells == nullptr); // no mapping in place
 
-      glUseProgram (P_compute);
-      glActiveTexture (GL_TEXTURE0);
-      glBindTexture (GL_TEXTURE_2D, T_output);
+      // With the damage overlay, the tint of cells damaged by earlier
+      // frames may be fading anywhere, so consider all of them
+      if (opts.showDamage)
+         fullDamage = true;
+
+      glUseProgram (P_cells);
+      if (useCompute)
+      {
+         glActiveTexture (GL_TEXTURE0);
+         glBindTexture (GL_TEXTURE_2D, T_output);
+      }
       glActiveTexture (GL_TEXTURE1);
       glBindTexture (GL_TEXTURE_2D_ARRAY, T_atlas);
       glActiveTexture (GL_TEXTURE2);
@@ -592,27 +1047,91 @@ namespace zutty
       }
       glCheckError ();
 
-      glDispatchCompute (nCols, nRows, 1);
-      glMemoryBarrier (GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-      glCheckError ();
+      // In a delta frame, only the damaged rows have anything to render
+      // (for quads, only if the back buffer keeps the rest)
+      int firstRow = 0;
+      int lastRow = nRows - 1;
+      if (!fullDamage && !damage.null () && (useCompute || bufferPreserved))
+      {
+         firstRow = damage.tl.y;
+         lastRow = damage.br.y;
+      }
+      const int drawRows = lastRow - firstRow + 1;
+      glUniform1i (cellsU_rowOffset, firstRow);
+
+      if (useCompute)
+      {
+         if (gpuTimer)
+            gpuTimer->begin (GpuTimer::Compute);
+         glDispatchCompute (nCols, drawRows, 1);
+         glMemoryBarrier (GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+         if (gpuTimer)
+            gpuTimer->end (GpuTimer::Compute);
+         glCheckError ();
+      }
+
+      // Convert damaged cells to window pixels (origin at bottom left)
+      Rect damagePx;
+      if (damage.tl == Point (0, 0) && damage.br == Point (nCols, nRows - 1))
+         fullDamage = true; // also present the border around the cells
+
+      if (!fullDamage && !damage.null ())
+      {
+         int x = opts.border + damage.tl.x * px;
+         int y = pxHeight - opts.border - (damage.br.y + 1) * py;
+         damagePx = Rect (x, y, x + (damage.br.x - damage.tl.x) * px,
+                          y + (damage.br.y - damage.tl.y + 1) * py);
+      }
+      damage.clear ();
+      fullDamage = false;
+      clearDirtyBits = !useCompute;
 
-      glUseProgram (P_draw);
+      glUseProgram (useCompute ? P_draw : P_cells);
+      if (bufferPreserved && !damagePx.null ())
+      {
+         glEnable (GL_SCISSOR_TEST);
+         glScissor (damagePx.tl.x, damagePx.tl.y,
+                    damagePx.br.x - damagePx.tl.x,
+                    damagePx.br.y - damagePx.tl.y);
+      }
+      if (gpuTimer)
+         gpuTimer->begin (GpuTimer::Draw);
       glClearColor (opts.bg.red / 255.0, opts.bg.green / 255.0,
                     opts.bg.blue / 255.0, 1.0);
       glClear (GL_COLOR_BUFFER_BIT);
 
-      glActiveTexture (GL_TEXTURE0);
-      glBindTexture (GL_TEXTURE_2D, T_output);
+      if (useCompute)
+      {
+         glActiveTexture (GL_TEXTURE0);
+         glBindTexture (GL_TEXTURE_2D, T_output);
+
+         glEnableVertexAttribArray (A_pos);
+         glEnableVertexAttribArray (A_vertexTexCoord);
+         glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+      }
+      else
+      {
+         // The scissor limits the work to the damage within the rows
+         setupCellAttributes (firstRow * nCols);
+         glDrawArraysInstanced (GL_TRIANGLE_STRIP, 0, 4, nCols * drawRows);
+      }
+      drawImages ();
+      glDisable (GL_SCISSOR_TEST);
+      if (gpuTimer)
+      {
+         gpuTimer->end (GpuTimer::Draw);
+         gpuTimer->endFrame ();
+      }
 
-      glEnableVertexAttribArray (A_pos);
-      glEnableVertexAttribArray (A_vertexTexCoord);
-      glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+      return damagePx;
    }
 
-   CharVdev::Mapping::Mapping (uint16_t nCols_, uint16_t nRows_, Cell *& cells_)
+   CharVdev::Mapping::Mapping (uint16_t nCols_, uint16_t nRows_, Cell *& cells_,
+                               GLenum target_)
       : nCols (nCols_)
       , nRows (nRows_)
       , cells (cells_)
+      , target (target_)
    {
    };
 
@@ -620,7 +1139,7 @@ namespace zutty
    {
       assert (cells != nullptr); // mapping in place
 
-      glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+      glUnmapBuffer (target);
       cells = nullptr;
    };
 
@@ -628,74 +1147,233 @@ namespace zutty
    {
       assert (cells == nullptr); // no mapping in place
 
+      glBindBuffer (bufferTarget (), B_text);
       cells = reinterpret_cast <Cell *> (
-                 glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                 glMapBufferRange (bufferTarget (),
                                    0, sizeof (Cell) * nRows * nCols,
                                    GL_MAP_READ_BIT | GL_MAP_WRITE_BIT));
 
-      return CharVdev::Mapping (nCols, nRows, cells);
+      // The compute shader clears the dirty bits of cells it has drawn;
+      // quads can't write back, so do that here, but only if they have
+      // been drawn (the renderer may map again without drawing).
+      if (clearDirtyBits)
+      {
+         for (int k = 0; k < nRows * nCols; ++k)
+            cells [k].dirty = 0;
+         clearDirtyBits = false;
+      }
+
+      return CharVdev::Mapping (nCols, nRows, cells, bufferTarget ());
    };
 
+   std::vector <std::string>
+   CharVdev::getGpuTimes () const
+   {
+      if (!gpuTimer)
+         return {};
+      return gpuTimer->summary ();
+   }
+
    // private methods
 
+   GLenum
+   CharVdev::bufferTarget () const
+   {
+      return useCompute ? GL_SHADER_STORAGE_BUFFER : GL_ARRAY_BUFFER;
+   }
+
    void
    CharVdev::createShaders ()
    {
-      GLuint S_compute, S_fragment, S_vertex;
-
-      S_compute =
-         createShader (GL_COMPUTE_SHADER, computeShaderSource, "compute");
-      S_fragment =
-         createShader (GL_FRAGMENT_SHADER, fragmentShaderSource, "fragment");
-      S_vertex =
-         createShader (GL_VERTEX_SHADER, vertexShaderSource, "vertex");
-
-      P_compute = glCreateProgram ();
-      glAttachShader (P_compute, S_compute);
-      linkProgram (P_compute, "compute");
-      glUseProgram (P_compute);
-
-      compU_glyphPixels = glGetUniformLocation (P_compute, "glyphPixels");
-      compU_sizeChars = glGetUniformLocation (P_compute, "sizeChars");
-      compU_cursorColor = glGetUniformLocation (P_compute, "cursorColor");
-      compU_cursorPos = glGetUniformLocation (P_compute, "cursorPos");
-      compU_cursorStyle = glGetUniformLocation (P_compute, "cursorStyle");
-      compU_selectRect = glGetUniformLocation (P_compute, "selectRect");
-      compU_selectRectMode = glGetUniformLocation (P_compute, "selectRectMode");
-      compU_selectDamage = glGetUniformLocation (P_compute, "selectDamage");
-      compU_deltaFrame = glGetUniformLocation (P_compute, "deltaFrame");
-      compU_showWraps = glGetUniformLocation (P_compute, "showWraps");
-      compU_hasDoubleWidth = glGetUniformLocation (P_compute, "hasDoubleWidth");
-
-      logT << "compute program:"
-           << " uniform glyphPixels=" << compU_glyphPixels
-           << " sizeChars=" << compU_sizeChars
-           << " cursorColor=" << compU_cursorColor
-           << " cursorPos=" << compU_cursorPos
-           << " cursorStyle=" << compU_cursorStyle
-           << " selectRect=" << compU_selectRect
-           << " selectRectMode=" << compU_selectRectMode
-           << " selectDamage=" << compU_selectDamage
-           << " deltaFrame=" << compU_deltaFrame
-           << " showWraps=" << compU_showWraps
-           << " hasDoubleWidth=" << compU_hasDoubleWidth
-           << std::endl;
+      // Settings fixed for the lifetime of CharVdev are compiled in
+      std::ostringstream oss;
+      oss << "#define GLYPH_PX " << px << "\n"
+          << "#define GLYPH_PY " << py << "\n"
+          << "#define HAS_DOUBLE_WIDTH " << (hasDoubleWidth ? 1 : 0) << "\n"
+          << "#define SHOW_WRAPS " << (opts.showWraps ? 1 : 0) << "\n"
+          << "#define SHOW_DAMAGE " << (opts.showDamage ? 1 : 0) << "\n"
+          << "#define DAMAGE_FADE_FRAMES " << damageFadeFrames << "\n";
+      const std::string defines = oss.str ();
+      logT << "Shader defines:\n" << defines;
+
+      if (useCompute)
+      {
+         GLuint S_compute, S_fragment, S_vertex;
+
+         S_compute = createShader (GL_COMPUTE_SHADER, computeShaderSource,
+                                   defines, "compute");
+         S_fragment = createShader (GL_FRAGMENT_SHADER, fragmentShaderSource,
+                                    "", "fragment");
+         S_vertex = createShader (GL_VERTEX_SHADER, vertexShaderSource,
+                                  "", "vertex");
+
+         P_cells = glCreateProgram ();
+         glAttachShader (P_cells, S_compute);
+         linkProgram (P_cells, "compute");
+
+         P_draw = glCreateProgram ();
+         glAttachShader (P_draw, S_fragment);
+         glAttachShader (P_draw, S_vertex);
+         linkProgram (P_draw, "draw");
+         glUseProgram (P_draw);
+
+         A_pos = glGetAttribLocation (P_draw, "pos");
+         A_vertexTexCoord = glGetAttribLocation (P_draw, "vertexTexCoord");
+         drawU_viewPixels = glGetUniformLocation (P_draw, "viewPixels");
+
+         logT << "draw program:"
+              << " attrib pos=" << A_pos
+              << " vertexTexCoord=" << A_vertexTexCoord
+              << " uniform viewPixels=" << drawU_viewPixels
+              << std::endl;
+      }
+      else
+      {
+         GLuint S_fragment, S_vertex;
+
+         S_fragment = createShader (GL_FRAGMENT_SHADER,
+                                    quadsFragmentShaderSource, defines,
+                                    "quads fragment");
+         S_vertex = createShader (GL_VERTEX_SHADER,
+                                  quadsVertexShaderSource, defines,
+                                  "quads vertex");
+
+         P_cells = glCreateProgram ();
+         glAttachShader (P_cells, S_fragment);
+         glAttachShader (P_cells, S_vertex);
+         linkProgram (P_cells, "quads");
+
+         A_cell = glGetAttribLocation (P_cells, "cell");
+         A_nextCell = glGetAttribLocation (P_cells, "nextCell");
+
+         logT << "quads program:"
+              << " attrib cell=" << A_cell
+              << " nextCell=" << A_nextCell
+              << std::endl;
+      }
 
-      P_draw = glCreateProgram ();
-      glAttachShader (P_draw, S_fragment);
-      glAttachShader (P_draw, S_vertex);
-      linkProgram (P_draw, "draw");
-      glUseProgram (P_draw);
+      GLuint S_imageFragment, S_imageVertex;
+      S_imageFragment = createShader (GL_FRAGMENT_SHADER,
+                                      imageFragmentShaderSource, "",
+                                      "image fragment");
+      S_imageVertex = createShader (GL_VERTEX_SHADER,
+                                    imageVertexShaderSource, "",
+                                    "image vertex");
+      P_image = glCreateProgram ();
+      glAttachShader (P_image, S_imageFragment);
+      glAttachShader (P_image, S_imageVertex);
+      linkProgram (P_image, "image");
+      glUseProgram (P_image);
+      glUniform1i (glGetUniformLocation (P_image, "image"), 5);
+      imageU_viewPixels = glGetUniformLocation (P_image, "viewPixels");
+      imageU_dstRect = glGetUniformLocation (P_image, "dstRect");
+      imageU_srcRect = glGetUniformLocation (P_image, "srcRect");
+      glGetIntegerv (GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+      logT << "image program:"
+           << " uniform viewPixels=" << imageU_viewPixels
+           << " dstRect=" << imageU_dstRect
+           << " srcRect=" << imageU_srcRect
+           << std::endl;
 
-      A_pos = glGetAttribLocation (P_draw, "pos");
-      A_vertexTexCoord = glGetAttribLocation (P_draw, "vertexTexCoord");
-      drawU_viewPixels = glGetUniformLocation (P_draw, "viewPixels");
+      glUseProgram (P_cells);
+      getUniformLocations ();
+   }
 
-      logT << "draw program:"
-           << " attrib pos=" << A_pos
-           << " vertexTexCoord=" << A_vertexTexCoord
-           << " uniform viewPixels=" << drawU_viewPixels
+   void
+   CharVdev::getUniformLocations ()
+   {
+      // Uniforms not used by the current cells program get location -1,
+      // which makes any glUniform* call on them silently ignored.
+      cellsU_sizeChars = glGetUniformLocation (P_cells, "sizeChars");
+      cellsU_cursorColor = glGetUniformLocation (P_cells, "cursorColor");
+      cellsU_cursorPos = glGetUniformLocation (P_cells, "cursorPos");
+      cellsU_cursorStyle = glGetUniformLocation (P_cells, "cursorStyle");
+      cellsU_selectRect = glGetUniformLocation (P_cells, "selectRect");
+      cellsU_selectRectMode = glGetUniformLocation (P_cells, "selectRectMode");
+      cellsU_selectArea = glGetUniformLocation (P_cells, "selectArea");
+      cellsU_selectDamage = glGetUniformLocation (P_cells, "selectDamage");
+      cellsU_deltaFrame = glGetUniformLocation (P_cells, "deltaFrame");
+      cellsU_viewPixels = glGetUniformLocation (P_cells, "viewPixels");
+      cellsU_rowOffset = glGetUniformLocation (P_cells, "rowOffset");
+
+      logT << "cells program:"
+           << " uniform sizeChars=" << cellsU_sizeChars
+           << " cursorColor=" << cellsU_cursorColor
+           << " cursorPos=" << cellsU_cursorPos
+           << " cursorStyle=" << cellsU_cursorStyle
+           << " selectRect=" << cellsU_selectRect
+           << " selectRectMode=" << cellsU_selectRectMode
+           << " selectArea=" << cellsU_selectArea
+           << " selectDamage=" << cellsU_selectDamage
+           << " deltaFrame=" << cellsU_deltaFrame
+           << " viewPixels=" << cellsU_viewPixels
+           << " rowOffset=" << cellsU_rowOffset
            << std::endl;
    }
 
+   void
+   CharVdev::drawImages ()
+   {
+      if (images.empty ())
+         return;
+
+      glUseProgram (P_image);
+      glEnable (GL_BLEND);
+      glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      for (const auto& p: images)
+      {
+         const Image& img = *p.image;
+         if (img.width > maxTextureSize || img.height > maxTextureSize)
+            continue;
+
+         glActiveTexture (GL_TEXTURE5);
+         glBindTexture (GL_TEXTURE_2D, getImageTexture (img));
+         glUniform4f (imageU_dstRect, p.col * px, p.row * py,
+                      p.width, p.height);
+         glUniform4f (imageU_srcRect,
+                      (GLfloat)p.src.tl.x / img.width,
+                      (GLfloat)p.src.tl.y / img.height,
+                      (GLfloat)(p.src.br.x - p.src.tl.x) / img.width,
+                      (GLfloat)(p.src.br.y - p.src.tl.y) / img.height);
+         glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+      }
+      glDisable (GL_BLEND);
+      glCheckError ();
+   }
+
+   GLuint
+   CharVdev::getImageTexture (const Image& image)
+   {
+      auto it = imageTextures.find (&image);
+      if (it != imageTextures.end ())
+         return it->second;
+
+      GLuint texture = 0;
+      setupTexture (GL_TEXTURE5, GL_TEXTURE_2D, texture);
+      glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, image.rgba.data ());
+      glCheckError ();
+      imageTextures [&image] = texture;
+      return texture;
+   }
+
+   void
+   CharVdev::setupCellAttributes (uint32_t firstCell)
+   {
+      // The cell buffer from firstCell on, read twice: nextCell is offset
+      // by one cell
+      const size_t offset = sizeof (Cell) * firstCell;
+      glBindBuffer (GL_ARRAY_BUFFER, B_text);
+      glVertexAttribIPointer (A_cell, 3, GL_UNSIGNED_INT, sizeof (Cell),
+                              (const void*) offset);
+      glVertexAttribIPointer (A_nextCell, 3, GL_UNSIGNED_INT, sizeof (Cell),
+                              (const void*) (offset + sizeof (Cell)));
+      glVertexAttribDivisor (A_cell, 1);
+      glVertexAttribDivisor (A_nextCell, 1);
+      glEnableVertexAttribArray (A_cell);
+      glEnableVertexAttribArray (A_nextCell);
+      glCheckError ();
+   }
+
 } // namespace zutty
@@ -14,12 +14,16 @@
 #include "base.h"
 #include "fontpack.h"
 #include "gl.h"
+#include "gputimer.h"
+#include "image.h"
 #include "options.h"
 #include "utf8.h"
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace zutty
 {
@@ -31,7 +35,16 @@ namespace zutty
       ~CharVdev ();
 
       bool resize (uint16_t pxWidth_, uint16_t pxHeight_);
-      void draw ();
+
+      /* Render the cells and return the area of the window changed since
+       * the previous draw, in pixels with the origin at the bottom left
+       * (as expected by eglSwapBuffersWithDamage). A null Rect means that
+       * the whole window needs to be presented.
+       */
+      Rect draw ();
+
+      // Frames over which the tint of damaged cells fades (see showDamage)
+      static constexpr int damageFadeFrames = 8;
 
       struct Cell
       {
@@ -78,16 +91,21 @@ namespace zutty
 
       struct Mapping
       {
-         Mapping (uint16_t nCols_, uint16_t nRows_, Cell *& cells_);
+         Mapping (uint16_t nCols_, uint16_t nRows_, Cell *& cells_,
+                  GLenum target_);
          ~Mapping ();
 
          uint16_t nCols;
          uint16_t nRows;
          Cell *& cells;
+         GLenum target;
       };
 
       Mapping getMapping ();
 
+      // Summary of the GPU timers (see -gpuTimers); empty if not measured
+      std::vector <std::string> getGpuTimes () const;
+
       struct Cursor
       {
          Color color = opts.cr;
@@ -101,11 +119,25 @@ namespace zutty
             hollow_block = 2
          };
          Style style = Style::hidden;
+
+         bool operator == (const Cursor& rhs) const
+         {
+            return color == rhs.color && posX == rhs.posX &&
+                   posY == rhs.posY && style == rhs.style;
+         }
+
+         bool operator != (const Cursor& rhs) const
+         {
+            return ! operator == (rhs);
+         }
       };
 
       void setCursor (const Cursor& cursor);
-      void setSelection (const Rect& selection);
+      // Cells outside area (whole grid if null) are never shown selected
+      void setSelection (const Rect& selection, const Rect& area = Rect ());
       void setDeltaFrame (bool delta);
+      void addDamage (const Rect& damage);
+      void setImages (const std::vector <ImagePlacement>& images);
 
    private:
       uint16_t px;
@@ -115,25 +147,54 @@ namespace zutty
       uint16_t pxWidth;
       uint16_t pxHeight;
       bool hasDoubleWidth = false;
-
-      // GL ids of programs, buffers, textures, attributes and uniforms:
-      GLuint P_compute, P_draw;
+      /* Render the cells with a compute shader (GLES 3.1) into an image
+       * that is drawn onto the window, or else (GLES 3.0) by drawing an
+       * instanced quad per cell straight into the window.
+       */
+      bool useCompute = true;
+      bool bufferPreserved = false; // back buffer retained across swaps?
+      Rect damage; // cells to be presented by next draw; null: nothing
+      bool fullDamage = true;
+      bool clearDirtyBits = false; // quads drawn since last mapping?
+
+      // GL ids of programs, buffers, textures, attributes and uniforms.
+      // P_cells renders the cells: either the compute or the quads program.
+      GLuint P_cells, P_draw;
       GLuint B_text = 0;
+      GLuint B_damage = 0; // heat of cells for the damage overlay
       GLuint T_atlas = 0;
       GLuint T_atlasMap = 0;
       GLuint T_atlas_dw = 0;
       GLuint T_atlasMap_dw = 0;
       GLuint T_output = 0;
+      uint32_t outputWidth = 0; // allocated size of T_output
+      uint32_t outputHeight = 0;
+      uint32_t bufferCells = 0; // allocated size of B_text
       GLint A_pos, A_vertexTexCoord;
-      GLint compU_glyphPixels, compU_sizeChars, compU_cursorColor;
-      GLint compU_cursorPos, compU_cursorStyle;
-      GLint compU_selectRect, compU_selectRectMode, compU_selectDamage;
-      GLint compU_deltaFrame, compU_showWraps, compU_hasDoubleWidth;
+      GLint A_cell, A_nextCell;
+      GLint cellsU_sizeChars, cellsU_cursorColor;
+      GLint cellsU_cursorPos, cellsU_cursorStyle;
+      GLint cellsU_selectRect, cellsU_selectRectMode, cellsU_selectDamage;
+      GLint cellsU_selectArea;
+      GLint cellsU_deltaFrame, cellsU_viewPixels, cellsU_rowOffset;
       GLint drawU_viewPixels;
+      GLuint P_image;
+      GLint imageU_viewPixels, imageU_dstRect, imageU_srcRect;
+      GLint maxTextureSize = 0;
+
+      std::vector <ImagePlacement> images; // drawn on top of the cells
+      std::map <const Image*, GLuint> imageTextures;
+
+      std::unique_ptr <GpuTimer> gpuTimer; // null unless -gpuTimers
 
       Cell * cells = nullptr; // valid pointer if mapped, else nullptr
 
+      GLenum bufferTarget () const;
       void createShaders ();
+      void getUniformLocations ();
+      void setupCellAttributes (uint32_t firstCell);
+      void drawImages ();
+      GLuint getImageTexture (const Image& image);
    };
 
 } // namespace zutty
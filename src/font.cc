@@ -53,6 +53,50 @@ namespace zutty
       load ();
    }
 
+   std::vector <Font::AtlasPos>
+   Font::getAtlasLookup () const
+   {
+      const auto itEnd = atlasMap.end ();
+
+      AtlasPos apRC {};
+      {
+         auto rcIt = atlasMap.find (Unicode_Replacement_Character);
+         if (rcIt != itEnd)
+            apRC = rcIt->second;
+      }
+
+      AtlasPos apMG {};
+      {
+         auto mgIt = atlasMap.find (Missing_Glyph_Marker);
+         if (mgIt != itEnd)
+            apMG = mgIt->second;
+      }
+
+      std::vector <AtlasPos> lookup (256 * 256);
+      for (int k = 0; k < 256 * 256; ++k)
+         lookup [k] = ((k >= 0xd800 && k < 0xe000) || k >= 0xfffe)
+                    ? apRC
+                    : apMG;
+
+      for (auto it = atlasMap.begin (); it != itEnd; ++it)
+         lookup [it->first] = it->second;
+
+      return lookup;
+   }
+
+   bool
+   Font::isBlank (const AtlasPos& apos) const
+   {
+      const size_t stride = nx * px;
+      const uint8_t* row = atlasBuf.data () + apos.y * py * stride +
+                           apos.x * px;
+      for (int j = 0; j < py; ++j, row += stride)
+         for (int k = 0; k < px; ++k)
+            if (row [k])
+               return false;
+      return true;
+   }
+
    // private methods
 
    bool Font::isLoadableChar (FT_ULong c)
@@ -73,6 +73,16 @@ namespace zutty
       using AtlasMap = std::map <uint16_t, AtlasPos>;
       const AtlasMap& getAtlasMap () const { return atlasMap; };
 
+      /* Return a table of atlas positions indexed by code point, covering
+       * the whole 16-bit range. Code points without a glyph are mapped to
+       * the "replacement character" (surrogates and non-characters) or the
+       * "missing glyph" glyphs, if available in the font.
+       */
+      std::vector <AtlasPos> getAtlasLookup () const;
+
+      // Whether the glyph at the given atlas position has no ink at all
+      bool isBlank (const AtlasPos& apos) const;
+
    private:
       std::string filename;
       bool overlay = false;
@@ -314,4 +314,46 @@ namespace zutty
       }
    }
 
+   std::vector <Font::AtlasPos>
+   Fontpack::getAtlasLookup (bool doubleWidth) const
+   {
+      std::vector <const Font*> variants;
+      if (doubleWidth)
+         variants.push_back (&getDoubleWidth ());
+      else
+         for (const auto& fnt: {fontRegular.get (), fontBold.get (),
+                                fontItalic.get (), fontBoldItalic.get ()})
+            if (fnt)
+               variants.push_back (fnt);
+
+      const Font& fnt = * variants [0];
+      std::vector <Font::AtlasPos> lookup = fnt.getAtlasLookup ();
+
+      // Blankness per atlas position: 0: unknown, 1: blank, 2: has ink
+      std::vector <uint8_t> blank (fnt.getNx () * fnt.getNy (), 0);
+      int nBlank = 0;
+      for (auto& apos: lookup)
+      {
+         uint8_t& b = blank [apos.y * fnt.getNx () + apos.x];
+         if (b == 0)
+         {
+            b = 1;
+            for (const Font* v: variants)
+               if (! v->isBlank (apos))
+               {
+                  b = 2;
+                  break;
+               }
+            if (b == 1)
+               ++nBlank;
+         }
+         if (b == 1)
+            apos = Font::AtlasPos {};
+      }
+      logT << "Atlas lookup" << (doubleWidth ? " (double-width)" : "")
+           << ": " << nBlank << " blank glyph(s)" << std::endl;
+
+      return lookup;
+   }
+
 } // namespace zutty
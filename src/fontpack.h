@@ -17,6 +17,7 @@
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace zutty
 {
@@ -75,6 +76,14 @@ namespace zutty
          return * fontDoubleWidth.get ();
       };
 
+      /* Return the atlas lookup table (see Font::getAtlasLookup) of the
+       * regular, or the double-width font. Code points with a glyph that
+       * is blank in all the loaded style variants are mapped to the blank
+       * glyph at (0,0), so renderers can fill those cells with background
+       * only, without touching the atlas.
+       */
+      std::vector <Font::AtlasPos> getAtlasLookup (bool doubleWidth) const;
+
       void releaseFonts ()
       {
          fontRegular = nullptr;
@@ -12,6 +12,43 @@
 #include "frame.h"
 #include "log.h"
 
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+   // Blank cells of the text: spaces and double-width continuations
+   inline bool
+   isBlank (uint16_t ch)
+   {
+      return ch == ' ' || ch == 0;
+   }
+
+   /* Return end, moved back over the blank cells in [begin, end) of text.
+    * Whole blocks of cells are checked at once, in a loop that compiles
+    * to vector compares.
+    */
+   int
+   trimBlanks (const uint16_t* text, int begin, int end)
+   {
+      constexpr const int block = 16;
+      while (end - begin >= block)
+      {
+         const uint16_t* p = text + end - block;
+         int nonBlank = 0;
+         for (int k = 0; k < block; ++k)
+            nonBlank |= (p [k] != ' ') & (p [k] != 0);
+         if (nonBlank)
+            break;
+         end -= block;
+      }
+      while (end > begin && isBlank (text [end - 1]))
+         --end;
+      return end;
+   }
+
+} // namespace
+
 namespace zutty
 {
    Frame::Frame () {}
@@ -32,6 +69,7 @@ namespace zutty
       , viewOffset (0)
       , margins (false)
       , cells (CharVdev::make_cells (nCols, nRows + saveLines))
+      , text (makeText (nCols * (nRows + saveLines)))
    {
       marginTop_ = marginTop;
       marginBottom_ = nRows;
@@ -42,15 +80,109 @@ namespace zutty
    void
    Frame::dropScrollbackHistory ()
    {
+      historyFillRows = 0;
       viewOffset = 0;
       historyRows = 0;
+      images.erase (std::remove_if (images.begin (), images.end (),
+                                    [] (const ImagePlacement& p)
+                                    { return p.row < 0; }),
+                    images.end ());
       expose ();
    }
 
+   /* Scroll up count rows without margins, as if the bottom row was written
+    * over and over again (wrapping onto a new row each time), with all rows
+    * above it looking the same: the rows scrolled into the history are all
+    * copies of the one above the bottom row, which keeps its contents.
+    * Used by Vterm::csi_REP. Once the whole history is made of such copies
+    * (see historyFill), doing this again costs next to nothing.
+    */
+   void
+   Frame::scrollUpRepeat (uint16_t count)
+   {
+      count = std::min (count, saveLines);
+      if (margins || nRows < 2 || !count)
+         return;
+
+      const size_t rowBytes = nCols * cellSize;
+      auto rowPtr = [this] (int pY)
+      {
+         return &cells.get () [nCols * getPhysicalRow (pY - viewOffset)];
+      };
+      auto textPtr = [this] (int pY)
+      {
+         return &text.get () [nCols * getPhysicalRow (pY - viewOffset)];
+      };
+      const size_t textBytes = nCols * sizeof (uint16_t);
+      const int fillRows =
+         historyFillRows &&
+         memcmp (historyFill.data (), rowPtr (nRows - 2), rowBytes) == 0
+         ? historyFillRows : 0;
+      const std::vector <CharVdev::Cell> bottom (rowPtr (nRows - 1),
+                                                 rowPtr (nRows - 1) + nCols);
+      const std::vector <uint16_t> bottomText (textPtr (nRows - 1),
+                                               textPtr (nRows - 1) + nCols);
+      invalidateSelection (Rect (0, nRows - 1, nCols, nRows - 1));
+      vscrollSelection (-count);
+      vscrollImages (-count);
+      scrollHead = (scrollHead + count) % (nRows + saveLines);
+      historyRows = std::min (historyRows + count, (int)saveLines);
+
+      // The old bottom row is now above the rows that used to be the oldest
+      // history rows (already copies if all of the history is), and the one
+      // below them is the new bottom row
+      const CharVdev::Cell* row = rowPtr (nRows - 2 - count);
+      const uint16_t* rowText = textPtr (nRows - 2 - count);
+      memcpy (rowPtr (nRows - 1 - count), row, rowBytes);
+      memcpy (textPtr (nRows - 1 - count), rowText, textBytes);
+      if (fillRows < saveLines)
+         for (int pY = nRows - count; pY < nRows - 1; ++pY)
+         {
+            memcpy (rowPtr (pY), row, rowBytes);
+            memcpy (textPtr (pY), rowText, textBytes);
+         }
+      memcpy (rowPtr (nRows - 1), bottom.data (), rowBytes);
+      memcpy (textPtr (nRows - 1), bottomText.data (), textBytes);
+      damageScrollArea ();
+
+      historyFill.assign (row, row + nCols);
+      historyFillRows = std::min (fillRows + count, (int)saveLines);
+   }
+
+   // Called before scrolling up count rows, to keep historyFillRows valid
+   void
+   Frame::checkHistoryFill (uint16_t count)
+   {
+      if (margins)
+         return; // the history is not affected
+      if (count > nRows && historyFillRows < saveLines)
+      {
+         historyFillRows = 0; // older history rows come around
+         return;
+      }
+      for (int pY = 0; pY < std::min (count, nRows); ++pY)
+         if (memcmp (getPhysRowPtr (pY - viewOffset), historyFill.data (),
+                     nCols * cellSize) != 0)
+         {
+            historyFillRows = 0;
+            return;
+         }
+      historyFillRows = std::min (historyFillRows + count, (int)saveLines);
+   }
+
+   /* Without margins, the whole cell storage (history included) is the
+    * scrolling area. Setting margins leaves it as it is, rotated by
+    * ringBase, instead of moving the rows into place: that would cost
+    * as much as copying the whole history, for each DECSTBM.
+    */
    void
    Frame::setMargins (uint16_t marginTop_, uint16_t marginBottom_)
    {
-      unwrapCellStorage ();
+      historyFillRows = 0;
+      if (margins)
+         unwrapScrollArea ();
+      else
+         ringBase = scrollHead;
       scrollHead = marginTop = marginTop_;
       marginBottom = marginBottom_;
       margins = true;
@@ -60,8 +192,14 @@ namespace zutty
    void
    Frame::resetMargins (uint16_t& marginTop_, uint16_t& marginBottom_)
    {
-      unwrapCellStorage ();
-      scrollHead = marginTop = marginTop_ = 0;
+      historyFillRows = 0;
+      if (margins)
+      {
+         unwrapScrollArea ();
+         scrollHead = ringBase;
+         ringBase = 0;
+      }
+      marginTop = marginTop_ = 0;
       marginBottom = nRows + saveLines;
       marginBottom_ = nRows;
       margins = false;
@@ -83,27 +221,32 @@ namespace zutty
          return;
 
       auto newCells = CharVdev::make_cells (nCols_, nRows_ + saveLines);
+      auto newText = makeText (nCols_ * (nRows_ + saveLines));
       CharVdev::Cell* dst = newCells.get ();
+      uint16_t* dstText = newText.get ();
 
       const int rowLen = std::min (nCols, nCols_);
       const int nCopyRows = std::min (nRows, nRows_);
-      CharVdev::Cell* p = dst;
-      for (int pY = 0; pY < nCopyRows; ++pY)
+      auto copyRow = [&] (int pY, int k)
       {
-         memcpy (p, getPhysRowPtr (pY), rowLen * cellSize);
-         p += nCols_;
-      }
-      p = dst + (nRows_ + saveLines - historyRows) * nCols_;
+         const int srcIdx = nCols * getPhysicalRow (pY);
+         memcpy (dst + k * nCols_, &operator [] (srcIdx), rowLen * cellSize);
+         memcpy (dstText + k * nCols_, text.get () + srcIdx,
+                 rowLen * sizeof (uint16_t));
+      };
+      for (int pY = 0; pY < nCopyRows; ++pY)
+         copyRow (pY, pY);
+      const int historyBase = nRows_ + saveLines - historyRows;
       for (int pY = -historyRows; pY < 0; ++pY)
-      {
-         memcpy (p, getPhysRowPtr (pY), rowLen * cellSize);
-         p += nCols_;
-      }
+         copyRow (pY, historyBase + historyRows + pY);
 
       cells = std::move (newCells);
+      text = std::move (newText);
+      historyFillRows = 0;
       nCols = nCols_;
       nRows = nRows_;
       scrollHead = 0;
+      ringBase = 0;
       marginTop = marginTop_ = 0;
       marginBottom_ = nRows;
       marginBottom = nRows + saveLines;
@@ -114,25 +257,111 @@ namespace zutty
    }
 
    void
-   Frame::fullCopyCells (CharVdev::Cell * const dst)
+   Frame::fullCopyCells (CharVdev::Cell * const dst, uint16_t dstCols)
    {
+      const int stride = dstCols ? dstCols : nCols;
       CharVdev::Cell* p = dst;
       for (int pY = 0; pY < nRows; ++pY)
       {
          memcpy (p, getViewRowPtr (pY), nCols * cellSize);
-         p += nCols;
+         p += stride;
       }
    }
 
-   void
-   Frame::deltaCopyCells (CharVdev::Cell * const dst)
+   // Returns the rows (in view coordinates) with changed cells
+   Rect
+   Frame::deltaCopyCells (CharVdev::Cell * const dst, uint16_t dstCols)
    {
+      const int stride = dstCols ? dstCols : nCols;
+      Rect changed;
+      if (damage.start == 0 && damage.end == damage.totalCells)
+         changed = Rect (0, 0, nCols, nRows - 1); // e.g., exposed
+
       CharVdev::Cell* p = dst;
       for (int pY = -viewOffset; pY < nRows - viewOffset; ++pY)
       {
-         damageDeltaCopy (p, nCols * getPhysicalRow (pY), nCols);
-         p += nCols;
+         if (damageDeltaCopy (p, nCols * getPhysicalRow (pY), nCols))
+         {
+            const int y = pY + viewOffset;
+            if (changed.null ())
+               changed = Rect (0, y, nCols, y);
+            else
+               changed.br.y = std::max (changed.br.y, y);
+         }
+         p += stride;
+      }
+      return changed;
+   }
+
+   void
+   Frame::placeImage (const ImagePlacement& placement)
+   {
+      if (placement.placementId)
+         deleteImages (placement.image->id, placement.placementId);
+
+      // Drop placements entirely covered by the new one, so that images
+      // repeatedly drawn at the same place (e.g., sixel animations) do
+      // not pile up
+      const Rect r = placement.cellRect ();
+      images.erase (std::remove_if (images.begin (), images.end (),
+                                    [&] (const ImagePlacement& p)
+                                    {
+                                       const Rect c = p.cellRect ();
+                                       return (c.tl.x >= r.tl.x &&
+                                               c.tl.y >= r.tl.y &&
+                                               c.br.x <= r.br.x &&
+                                               c.br.y <= r.br.y);
+                                    }),
+                    images.end ());
+      images.push_back (placement);
+
+      // Keep the images referenced within quota, dropping the oldest
+      // placements (most likely scrolled out of view) first
+      for (;;)
+      {
+         std::vector <const Image*> seen;
+         size_t bytes = 0;
+         for (const auto& p: images)
+            if (std::find (seen.begin (), seen.end (), p.image.get ()) ==
+                seen.end ())
+            {
+               seen.push_back (p.image.get ());
+               bytes += p.image->rgba.size ();
+            }
+         if (bytes <= imageQuota || images.size () == 1)
+            break;
+         images.erase (images.begin ());
+      }
+   }
+
+   void
+   Frame::deleteImages (uint32_t imageId, uint32_t placementId)
+   {
+      images.erase (std::remove_if (images.begin (), images.end (),
+                                    [=] (const ImagePlacement& p)
+                                    {
+                                       return (imageId == 0 ||
+                                               (p.image->id == imageId &&
+                                                (placementId == 0 ||
+                                                 p.placementId == placementId)));
+                                    }),
+                    images.end ());
+   }
+
+   std::vector <ImagePlacement>
+   Frame::getVisibleImages () const
+   {
+      std::vector <ImagePlacement> visible;
+      for (const auto& p: images)
+      {
+         const int row = p.row + viewOffset;
+         if (row < nRows && row + p.rows > 0)
+         {
+            visible.push_back (p);
+            visible.back ().row = row;
+         }
       }
+      return visible;
    }
 
    Rect
@@ -152,16 +381,16 @@ namespace zutty
          break;
       case SelectSnapTo::Word:
       {
-         const auto* cp = getViewRowPtr (ret.tl.y);
-         while (ret.tl.x < nCols && cp [ret.tl.x].uc_pt == ' ')
+         const uint16_t* tp = getViewTextPtr (ret.tl.y);
+         while (ret.tl.x < nCols && tp [ret.tl.x] == ' ')
             ++ret.tl.x;
-         while (ret.tl.x > 0 && cp [ret.tl.x - 1].uc_pt != ' ')
+         while (ret.tl.x > 0 && tp [ret.tl.x - 1] != ' ')
             --ret.tl.x;
 
-         cp = getViewRowPtr (ret.br.y);
-         while (ret.br.x > 0 && cp [ret.br.x].uc_pt == ' ')
+         tp = getViewTextPtr (ret.br.y);
+         while (ret.br.x > 0 && tp [ret.br.x] == ' ')
             --ret.br.x;
-         while (ret.br.x < nCols && cp [ret.br.x].uc_pt != ' ')
+         while (ret.br.x < nCols && tp [ret.br.x] != ' ')
             ++ret.br.x;
       }
          break;
@@ -183,40 +412,43 @@ namespace zutty
       if (sel.empty ())
          return false;
 
-      using utf16str = std::vector <uint16_t>;
-      std::vector <utf16str> lines;
+      std::string out;
+      size_t nLines = 0;
       bool wrap = false;
 
-      // save lines from the selected range of the frame cell buffer
+      /* Encode a line from the selected range of the frame text straight
+       * into the output. The extent of the text (up to a wrap, or without
+       * trailing whitespace) is found by a scan first, so no intermediate
+       * per-line buffers are needed.
+       */
       auto addLine =
          [&] (int y, uint16_t x1, uint16_t x2)
          {
-            utf16str line;
-            bool wrapBack = wrap;
-            wrap = false;
+            const bool wrapBack = wrap;
             const auto* cp = getViewRowPtr (y);
-            for (uint16_t x = x1; x < x2; ++x)
-            {
-               const auto& cell = cp [x];
-               if (!cell.dwidth_cont)
-                  line.push_back (cell.uc_pt);
-               if (cell.wrap)
-               {
-                  wrap = true;
-                  break;
-               }
-            }
-
-            while (!wrap && line.size () && line.back () == ' ')
-               line.pop_back (); // discard trailing whitespace
-
-            if (wrapBack && lines.size ())
-               lines.back ().insert (lines.back ().end (),
-                                     line.begin (), line.end ());
-            else
-               lines.push_back (line);
+            const uint16_t* tp = getViewTextPtr (y);
+            uint16_t end = x1;
+            while (end < x2 && !cp [end].wrap)
+               ++end;
+
+            wrap = end < x2;
+            if (wrap)
+               ++end; // include the wrapping cell
+            else // discard trailing whitespace
+               end = trimBlanks (tp, x1, end);
+
+            if (nLines++ && !wrapBack)
+               out.push_back ('\n');
+            for (uint16_t x = x1; x < end; ++x)
+               if (tp [x]) // not a double-width continuation
+                  Utf8Encoder::pushUnicode (tp [x],
+                                            [&] (char ch)
+                                            { out.push_back (ch); });
          };
 
+      const uint16_t lineLen = sel.rectangular ? sel.br.x - sel.tl.x : nCols;
+      out.reserve ((sel.br.y - sel.tl.y + 1) * (lineLen + 1));
+
       if (sel.tl.y == sel.br.y)
       {
          addLine (sel.tl.y, sel.tl.x, sel.br.x);
@@ -234,19 +466,10 @@ namespace zutty
          addLine (sel.br.y, 0, sel.br.x);
       }
 
-      // convert to UTF-8
-      std::vector <char> utf8_out;
-      auto sinkFn = [&] (char ch) { utf8_out.push_back (ch); };
-      for (const auto& u16s: lines)
-      {
-         for (uint16_t cp: u16s)
-            Utf8Encoder::pushUnicode (cp, sinkFn);
-         utf8_out.push_back ('\n');
-      }
-      while (utf8_out.size () && utf8_out.back () == '\n')
-         utf8_out.pop_back (); // discard trailing empty lines
+      while (out.size () && out.back () == '\n')
+         out.pop_back (); // discard trailing empty lines
 
-      utf8_selection = std::string (utf8_out.data (), utf8_out.size ());
+      utf8_selection = std::move (out);
 
    #if DEBUG
       if (utf8_selection.size () <= 80)
@@ -263,13 +486,13 @@ namespace zutty
 
    // private functions
 
-   inline void
+   inline bool
    Frame::damageDeltaCopy (CharVdev::Cell* dst, uint32_t start, uint32_t count)
    {
       uint32_t end = start + count;
 
       if (damage.end <= start || end <= damage.start)
-         return; // no intersection
+         return false; // no intersection
 
       if (start < damage.start)
       {
@@ -283,6 +506,7 @@ namespace zutty
       }
 
       CharVdev::Cell* const src = cells.get ();
+      bool changed = false;
 
       for (size_t i = 0, j = start; j < end; ++i, ++j)
       {
@@ -290,43 +514,54 @@ namespace zutty
          {
             dst [i] = src [j];
             dst [i].dirty = 1;
+            changed = true;
          }
       }
+      return changed;
    }
 
+   // Rotate the rows of the scrolling area (within margins, so at most a
+   // screenful) in place, so that its top row is at scrollHead
    void
-   Frame::copyAllCells (CharVdev::Cell * const dst)
+   Frame::unwrapScrollArea ()
    {
-      CharVdev::Cell* p = dst;
-      for (int pY = 0; pY < nRows; ++pY)
+      assert (margins);
+      if (scrollHead == marginTop)
+         return;
+
+      const int n = marginBottom - marginTop;
+      std::vector <CharVdev::Cell> rows (n * nCols);
+      std::vector <uint16_t> rowsText (n * nCols);
+      for (int k = 0; k < n; ++k)
       {
-         memcpy (p, getPhysRowPtr (pY), nCols * cellSize);
-         p += nCols;
+         const int idx = nCols * getPhysicalRow (marginTop + k);
+         memcpy (&rows [k * nCols], &operator [] (idx), nCols * cellSize);
+         memcpy (&rowsText [k * nCols], text.get () + idx,
+                 nCols * sizeof (uint16_t));
       }
-      p = dst + (nRows + saveLines - historyRows) * nCols;
-      for (int pY = -historyRows; pY < 0; ++pY)
+      scrollHead = marginTop;
+      for (int k = 0; k < n; ++k)
       {
-         memcpy (p, getPhysRowPtr (pY), nCols * cellSize);
-         p += nCols;
+         const int idx = nCols * getPhysicalRow (marginTop + k);
+         memcpy (&operator [] (idx), &rows [k * nCols], nCols * cellSize);
+         memcpy (text.get () + idx, &rowsText [k * nCols],
+                 nCols * sizeof (uint16_t));
       }
    }
 
-   void
-   Frame::unwrapCellStorage ()
+   std::shared_ptr <uint16_t>
+   Frame::makeText (uint32_t count)
    {
-      if (scrollHead == marginTop)
-         return;
-
-      auto newCells = CharVdev::make_cells (nCols, nRows + saveLines);
-      copyAllCells (newCells.get ());
-      cells = std::move (newCells);
-      scrollHead = marginTop;
+      std::shared_ptr <uint16_t> ret (new uint16_t [count],
+                                      std::default_delete <uint16_t []> ());
+      std::fill (ret.get (), ret.get () + count, CharVdev::Cell ().uc_pt);
+      return ret;
    }
 
    void
    Frame::highMemUsageReport ()
    {
-      auto allocKB = damage.totalCells * cellSize / 1024;
+      auto allocKB = damage.totalCells * (cellSize + sizeof (uint16_t)) / 1024;
       if (allocKB > 8192)
       {
          logI << "Allocated " << allocKB << " KiB for cell storage; consider "
@@ -35,14 +35,17 @@ namespace zutty
       void resetMargins (uint16_t& marginTop_, uint16_t& marginBottom_);
 
       void fillCells (uint16_t ch, const CharVdev::Cell& attrs);
-      void fullCopyCells (CharVdev::Cell * const dest);
-      void deltaCopyCells (CharVdev::Cell * const dest);
+      // dstCols is the row stride of dest (0: the same as nCols)
+      void fullCopyCells (CharVdev::Cell * const dest, uint16_t dstCols = 0);
+      Rect deltaCopyCells (CharVdev::Cell * const dest, uint16_t dstCols = 0);
 
       operator bool () const { return cells != nullptr; }
-      void freeCells () { cells = nullptr; }
+      void freeCells () { cells = nullptr; text = nullptr; }
 
       const CharVdev::Cell & getCell (uint16_t pY, uint16_t pX) const;
+      // N.B.: only for changing attributes; change code points via putCell
       CharVdev::Cell & getCell (uint16_t pY, uint16_t pX);
+      void putCell (uint16_t pY, uint16_t pX, const CharVdev::Cell& cell);
 
       void eraseInRow (uint16_t pY, uint16_t startX, uint16_t count,
                        const CharVdev::Cell& attrs);
@@ -53,6 +56,7 @@ namespace zutty
 
       void scrollUp (uint16_t count);
       void scrollDown (uint16_t count);
+      void scrollUpRepeat (uint16_t count);
 
       void pageUp (uint16_t count);
       void pageDown (uint16_t count);
@@ -61,6 +65,17 @@ namespace zutty
 
       void expose () { damage.expose (); };
       void resetDamage () { damage.reset (); };
+      bool hasDamage () const { return damage.start != damage.end; };
+      // Add the damage of an older, undrawn frame of the same terminal
+      void mergeDamage (const Frame& older);
+
+      // Images placed on the screen; see image.h
+      void placeImage (const ImagePlacement& placement);
+      // Delete the placements of imageId (0: all images), or only the
+      // one with placementId, if non-zero
+      void deleteImages (uint32_t imageId = 0, uint32_t placementId = 0);
+      // Placements intersecting the view, with rows in view coordinates
+      std::vector <ImagePlacement> getVisibleImages () const;
 
       const CharVdev::Cursor& getCursor () const { return cursor; };
       void setCursorPos (uint16_t pY, uint16_t pX);
@@ -94,12 +109,24 @@ namespace zutty
       uint16_t marginBottom; // current margin bottom (number of rows above + 1)
       uint16_t historyRows;  // number of history (off-screen) rows with data
       uint16_t viewOffset;   // how many rows above top row does the view start?
+      uint16_t ringBase = 0; // with margins: row offset of the whole storage
       bool margins = false;  // are there (non-default) top/bottom margins set?
+      // The newest historyFillRows rows of history are known to be copies
+      // of historyFill (see scrollUpRepeat)
+      std::vector <CharVdev::Cell> historyFill;
+      uint16_t historyFillRows = 0;
 
       CharVdev::Cell::Ptr cells = nullptr;
+      /* The code points of cells (0 for double-width continuations), laid
+       * out the same and kept in step with them, so that scans looking
+       * only at the text (selection snapping and trimming) don't have to
+       * read whole cells.
+       */
+      std::shared_ptr <uint16_t> text = nullptr;
       CharVdev::Cursor cursor;
       Rect selection;
       SelectSnapTo snapTo = SelectSnapTo::Char;
+      std::vector <ImagePlacement> images;
 
       struct Damage
       {
@@ -116,18 +143,26 @@ namespace zutty
       int getPhysicalRow (int pY) const;
       const CharVdev::Cell * getPhysRowPtr (int pY) const;
       const CharVdev::Cell * getViewRowPtr (int pY) const;
+      const uint16_t * getViewTextPtr (int pY) const;
       uint32_t getIdx (uint16_t pY, uint16_t pX) const;
       const CharVdev::Cell & operator [] (uint32_t idx) const;
       CharVdev::Cell & operator [] (uint32_t idx);
 
+      static uint16_t textOf (const CharVdev::Cell& cell)
+      {
+         return cell.dwidth_cont ? 0 : cell.uc_pt;
+      }
+      static std::shared_ptr <uint16_t> makeText (uint32_t count);
+
       void eraseRange (uint32_t start, uint32_t end,
                        const CharVdev::Cell& attrs);
       void copyCells (uint32_t dstIx, uint32_t srcIx, uint32_t count);
       void moveCells (uint32_t dstIx, uint32_t srcIx, uint32_t count);
 
-      void damageDeltaCopy (CharVdev::Cell* dst, uint32_t start, uint32_t count);
-      void copyAllCells (CharVdev::Cell * const dest);
-      void unwrapCellStorage ();
+      bool damageDeltaCopy (CharVdev::Cell* dst, uint32_t start, uint32_t count);
+      void damageScrollArea ();
+      void unwrapScrollArea ();
+      void checkHistoryFill (uint16_t count);
 
       static SelectSnapTo cycleSelectSnapTo (SelectSnapTo& snapTo)
       {
@@ -137,6 +172,7 @@ namespace zutty
       }
 
       void vscrollSelection (int vertOffset);
+      void vscrollImages (int vertOffset);
       void invalidateSelection (const Rect&& damage);
 
       void highMemUsageReport ();
@@ -0,0 +1,187 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "gputimer.h"
+#include "log.h"
+
+#include <GLES2/gl2ext.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+   const char* passNames [] = {"compute", "draw"};
+
+   // Results are 64 bits wide; the core glGetQueryObjectuiv would clamp
+   // them to 32 bits (about 4.3 seconds)
+   PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64v = nullptr;
+
+} // namespace
+
+namespace zutty
+{
+   bool
+   GpuTimer::isSupported ()
+   {
+      GLint n = 0;
+      glGetIntegerv (GL_NUM_EXTENSIONS, &n);
+      for (GLint k = 0; k < n; ++k)
+      {
+         const char* ext = reinterpret_cast <const char*> (
+            glGetStringi (GL_EXTENSIONS, k));
+         if (ext && strcmp (ext, "GL_EXT_disjoint_timer_query") == 0)
+         {
+            glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+               eglGetProcAddress ("glGetQueryObjectui64vEXT");
+            return glGetQueryObjectui64v != nullptr;
+         }
+      }
+      return false;
+   }
+
+   GpuTimer::GpuTimer ()
+   {
+      for (auto& slot: slots)
+         glGenQueries (nPasses, slot.queries);
+      // Reset the disjoint flag
+      GLint disjoint;
+      glGetIntegerv (GL_GPU_DISJOINT_EXT, &disjoint);
+      glCheckError ();
+   }
+
+   GpuTimer::~GpuTimer ()
+   {
+      for (auto& slot: slots)
+         glDeleteQueries (nPasses, slot.queries);
+   }
+
+   void
+   GpuTimer::begin (Pass pass)
+   {
+      Slot& slot = slots [current];
+      if (active >= 0 || slot.issued [pass])
+         return;
+      glBeginQuery (GL_TIME_ELAPSED_EXT, slot.queries [pass]);
+      active = pass;
+   }
+
+   void
+   GpuTimer::end (Pass pass)
+   {
+      if (active != pass)
+         return;
+      glEndQuery (GL_TIME_ELAPSED_EXT);
+      slots [current].issued [pass] = true;
+      active = -1;
+   }
+
+   void
+   GpuTimer::endFrame ()
+   {
+      if (active >= 0)
+         end (static_cast <Pass> (active));
+
+      // The first frame pays for lazy setup in the driver (and some
+      // report bogus times for it), so leave it out
+      if (firstFrame)
+      {
+         Slot& slot = slots [current];
+         std::fill (slot.issued, slot.issued + nPasses, false);
+         firstFrame = false;
+      }
+
+      // Collect starting with the oldest frame, which is reused next
+      current = (current + 1) % nSlots;
+      for (int k = 0; k < nSlots; ++k)
+         collect (slots [(current + k) % nSlots], false);
+      // Give up on results still not available by now
+      Slot& slot = slots [current];
+      std::fill (slot.issued, slot.issued + nPasses, false);
+   }
+
+   void
+   GpuTimer::flush ()
+   {
+      if (active >= 0)
+         end (static_cast <Pass> (active));
+      for (int k = 1; k <= nSlots; ++k)
+         collect (slots [(current + k) % nSlots], true);
+   }
+
+   std::vector <std::string>
+   GpuTimer::summary () const
+   {
+      std::vector <std::string> lines;
+      for (int p = 0; p < nPasses; ++p)
+      {
+         const Samples& s = samples [p];
+         if (!s.count)
+            continue;
+
+         std::vector <uint32_t> t (s.ns.begin (),
+                                   s.ns.begin () + std::min (s.count,
+                                                             (uint32_t)nSamples));
+         auto percentile = [&] (int pc)
+         {
+            auto nth = t.begin () + (t.size () - 1) * pc / 100;
+            std::nth_element (t.begin (), nth, t.end ());
+            return *nth / 1e6;
+         };
+         char buf [64];
+         snprintf (buf, sizeof (buf), "gpu %-7s %.2f/%.2f/%.2f ms",
+                   passNames [p], percentile (50), percentile (90),
+                   percentile (99));
+         lines.push_back (buf);
+      }
+      return lines;
+   }
+
+   // private methods
+
+   void
+   GpuTimer::collect (Slot& slot, bool wait)
+   {
+      // Results are available in the order of the queries
+      for (int p = 0; p < nPasses; ++p)
+      {
+         if (!slot.issued [p])
+            continue;
+
+         GLuint available = 0;
+         glGetQueryObjectuiv (slot.queries [p], GL_QUERY_RESULT_AVAILABLE,
+                              &available);
+         if (!available && !wait)
+            return;
+
+         GLuint64 ns = 0;
+         glGetQueryObjectui64v (slot.queries [p], GL_QUERY_RESULT, &ns);
+         slot.issued [p] = false;
+
+         GLint disjoint = 0;
+         glGetIntegerv (GL_GPU_DISJOINT_EXT, &disjoint);
+         if (disjoint)
+         {
+            logT << "GpuTimer: disjoint, dropping results" << std::endl;
+            for (auto& s: slots)
+               std::fill (s.issued, s.issued + nPasses, false);
+            return;
+         }
+
+         Samples& s = samples [p];
+         s.ns [s.count % nSamples] = std::min (ns, (GLuint64)UINT32_MAX);
+         ++s.count;
+      }
+      glCheckError ();
+   }
+
+} // namespace zutty
@@ -0,0 +1,80 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "gl.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zutty
+{
+   /* GPU time of the passes of rendering a frame, measured by timer
+    * queries (GL_EXT_disjoint_timer_query). The results are collected a
+    * few frames later, and only once available, so that measuring never
+    * stalls the pipeline. Results of frames disturbed by a disjoint event
+    * (e.g., a GPU clock change) are dropped.
+    */
+   class GpuTimer
+   {
+   public:
+      enum Pass { Compute, Draw, nPasses };
+
+      // Whether the extension is available in the current context
+      static bool isSupported ();
+
+      GpuTimer ();
+      ~GpuTimer ();
+
+      /* Measure the commands issued between begin () and end (). Passes
+       * can't overlap; a pass begun again within the same frame is only
+       * measured the first time.
+       */
+      void begin (Pass pass);
+      void end (Pass pass);
+
+      // Start measuring the next frame; collect the available results
+      void endFrame ();
+
+      // Wait for and collect all outstanding results
+      void flush ();
+
+      // Percentiles of the passes over the last frames, one line each
+      std::vector <std::string> summary () const;
+
+   private:
+      static constexpr const int nSlots = 4; // frames in flight
+      static constexpr const int nSamples = 256;
+
+      struct Slot
+      {
+         GLuint queries [nPasses];
+         bool issued [nPasses] = {};
+      };
+      std::array <Slot, nSlots> slots;
+      int current = 0;
+      int active = -1; // pass with a query in progress
+      bool firstFrame = true;
+
+      struct Samples
+      {
+         std::array <uint32_t, nSamples> ns;
+         uint32_t count = 0; // total, not only kept
+      };
+      std::array <Samples, nPasses> samples;
+
+      void collect (Slot& slot, bool wait);
+   };
+
+} // namespace zutty
@@ -0,0 +1,330 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "headless.h"
+#include "log.h"
+#include "options.h"
+#include "pty.h"
+#include "renderer.h"
+#include "vterm.h"
+
+#include <EGL/eglext.h>
+
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <sstream>
+#include <string.h>
+#include <termios.h>
+
+namespace
+{
+   using namespace zutty;
+
+   // Prefer a surfaceless display (no window system needed at all)
+   EGLDisplay
+   getHeadlessDisplay ()
+   {
+   #ifdef EGL_PLATFORM_SURFACELESS_MESA
+      auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+         eglGetProcAddress ("eglGetPlatformDisplayEXT");
+      if (getPlatformDisplay)
+      {
+         EGLDisplay dpy = getPlatformDisplay (EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, nullptr);
+         if (dpy != EGL_NO_DISPLAY)
+            return dpy;
+      }
+   #endif
+      return eglGetDisplay (EGL_DEFAULT_DISPLAY);
+   }
+
+   class Offscreen
+   {
+   public:
+      Offscreen (int width_, int height_)
+         : width (width_)
+         , height (height_)
+         , pixels (width_ * height_ * 4)
+      {
+         static const EGLint eglAttrs [] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_NONE
+         };
+         static const EGLint ctxAttrs [] = {
+            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_NONE
+         };
+         const EGLint surfAttrs [] = {
+            EGL_WIDTH, width,
+            EGL_HEIGHT, height,
+            EGL_NONE
+         };
+
+         EGLint major, minor, numConfigs;
+         EGLConfig config;
+
+         dpy = getHeadlessDisplay ();
+         if (dpy == EGL_NO_DISPLAY || !eglInitialize (dpy, &major, &minor))
+            throw std::runtime_error ("Couldn't initialize EGL display");
+
+         if (!eglChooseConfig (dpy, eglAttrs, &config, 1, &numConfigs) ||
+             numConfigs < 1)
+            throw std::runtime_error ("Couldn't get an EGL pbuffer config");
+
+         eglBindAPI (EGL_OPENGL_ES_API);
+         ctx = eglCreateContext (dpy, config, EGL_NO_CONTEXT, ctxAttrs);
+         if (!ctx)
+            throw std::runtime_error ("eglCreateContext failed");
+
+         surface = eglCreatePbufferSurface (dpy, config, surfAttrs);
+         if (!surface)
+            throw std::runtime_error ("eglCreatePbufferSurface failed");
+      }
+
+      ~Offscreen ()
+      {
+         eglDestroyContext (dpy, ctx);
+         eglDestroySurface (dpy, surface);
+         eglTerminate (dpy);
+      }
+
+      // Called on the render thread
+      void
+      makeCurrent ()
+      {
+         if (!eglMakeCurrent (dpy, surface, surface, ctx))
+            throw std::runtime_error ("eglMakeCurrent() failed");
+      }
+
+      // Called on the render thread
+      void
+      readPixels ()
+      {
+         glReadPixels (0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                       pixels.data ());
+         eglSwapBuffers (dpy, surface);
+      }
+
+      uint64_t
+      hash () const
+      {
+         uint64_t h = 0xcbf29ce484222325ULL;
+         for (size_t k = 0; k < pixels.size (); k += 4)
+            for (size_t c = 0; c < 3; ++c)
+            {
+               h ^= pixels [k + c];
+               h *= 0x100000001b3ULL;
+            }
+         return h;
+      }
+
+      void
+      writePPM (const std::string& path) const
+      {
+         FILE* f = fopen (path.c_str (), "wb");
+         if (!f)
+         {
+            SYS_WARN ("open ", path);
+            return;
+         }
+         fprintf (f, "P6\n%d %d\n255\n", width, height);
+         // GL rows are bottom-up
+         for (int y = height - 1; y >= 0; --y)
+            for (int x = 0; x < width; ++x)
+               fwrite (&pixels [(y * width + x) * 4], 1, 3, f);
+         fclose (f);
+      }
+
+   private:
+      int width;
+      int height;
+      EGLDisplay dpy;
+      EGLContext ctx;
+      EGLSurface surface;
+      std::vector <uint8_t> pixels;
+   };
+
+   void
+   setRawMode (int fd)
+   {
+      struct termios term;
+      if (tcgetattr (fd, &term) < 0)
+         SYS_ERROR ("tcgetattr");
+      cfmakeraw (&term);
+      if (tcsetattr (fd, TCSANOW, &term) < 0)
+         SYS_ERROR ("tcsetattr");
+   }
+
+   void
+   setNonBlocking (int fd)
+   {
+      int flags = fcntl (fd, F_GETFL);
+      if (flags < 0 || fcntl (fd, F_SETFL, flags | O_NONBLOCK) < 0)
+         SYS_ERROR ("fcntl (O_NONBLOCK)");
+   }
+
+} // namespace
+
+namespace zutty
+{
+   int
+   runHeadless (Fontpack* fontpk, const char* inputPath)
+   {
+      int inFd = STDIN_FILENO;
+      if (strcmp (inputPath, "-") != 0)
+      {
+         inFd = open (inputPath, O_RDONLY);
+         if (inFd < 0)
+         {
+            SYS_WARN ("open ", inputPath);
+            return 1;
+         }
+      }
+
+      int masterFd = -1;
+      int slaveFd = -1;
+      auto closeFds = [&] ()
+      {
+         if (inFd != STDIN_FILENO)
+            close (inFd);
+         if (masterFd >= 0)
+            close (masterFd);
+         if (slaveFd >= 0)
+            close (slaveFd);
+      };
+
+      int winWidth = 2 * opts.border + opts.nCols * fontpk->getPx ();
+      int winHeight = 2 * opts.border + opts.nRows * fontpk->getPy ();
+
+      std::unique_ptr <Offscreen> offscreen;
+      try
+      {
+         offscreen = std::make_unique <Offscreen> (winWidth, winHeight);
+      }
+      catch (const std::exception& e)
+      {
+         logE << "Headless: " << e.what () << std::endl;
+         closeFds ();
+         return 1;
+      }
+      Renderer renderer ([&] () { offscreen->makeCurrent (); },
+                         [&] (const Rect&) { offscreen->readPixels (); },
+                         fontpk);
+
+      // The input is written to the slave side of a pty, as if by a
+      // program running in the terminal; replies are read and discarded.
+      pty_open (masterFd, slaveFd);
+      setRawMode (slaveFd);
+      setNonBlocking (slaveFd);
+      pty_resize (masterFd, opts.nCols, opts.nRows);
+
+      Vterm vt (fontpk->getPx (), fontpk->getPy (),
+                winWidth, winHeight, masterFd);
+
+      bool ended = false;
+      auto syncPoint = [&] (const std::string& name)
+      {
+         vt.redraw (true); // even in the middle of synchronized output
+         renderer.sync ();
+         std::cout << name << " " << std::hex << std::setfill ('0')
+                   << std::setw (16) << offscreen->hash () << std::dec
+                   << std::endl;
+         const std::string ext = ".ppm";
+         if (name.size () > ext.size () &&
+             name.compare (name.size () - ext.size (), ext.size (), ext) == 0)
+            offscreen->writePPM (name);
+         if (name == "end")
+            ended = true;
+      };
+
+      vt.setRefreshHandler ([&] (const Frame& f) { renderer.update (f); });
+      vt.setOscHandler ([&] (int cmd, const std::string& arg)
+                        {
+                           if (cmd == oscSyncPoint)
+                              syncPoint (arg);
+                           else
+                              logT << "Headless: ignoring OSC " << cmd
+                                   << std::endl;
+                        });
+      vt.resize (winWidth, winHeight);
+
+      // Let the terminal consume what is pending on the pty, waiting for
+      // at most timeoutMs for data to arrive; discard terminal replies.
+      auto pump = [&] (int timeoutMs)
+      {
+         struct pollfd pfd {masterFd, POLLIN, 0};
+         while (poll (&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN))
+         {
+            vt.readPty ();
+            timeoutMs = 0;
+         }
+
+         char buf [4096];
+         while (read (slaveFd, buf, sizeof (buf)) > 0)
+            ;
+      };
+
+      auto feed = [&] (const char* data, ssize_t len)
+      {
+         ssize_t pos = 0;
+         while (pos < len)
+         {
+            ssize_t k = write (slaveFd, data + pos, len - pos);
+            if (k < 0 && errno != EAGAIN && errno != EINTR)
+               SYS_ERROR ("write to pty");
+            if (k > 0)
+               pos += k;
+            pump (k > 0 ? 0 : 10);
+         }
+      };
+
+      char buf [4096];
+      ssize_t n;
+      while ((n = read (inFd, buf, sizeof (buf))) != 0)
+      {
+         if (n < 0)
+         {
+            if (errno == EINTR)
+               continue;
+            SYS_WARN ("read ", inputPath);
+            break;
+         }
+         feed (buf, n);
+      }
+
+      // The pty delivers data asynchronously, so mark the end of input
+      // in-band and wait for the terminal to get there.
+      std::ostringstream oss;
+      oss << "\e]" << oscSyncPoint << ";end\a";
+      feed (oss.str ().data (), oss.str ().size ());
+      for (int k = 0; k < 100 && !ended; ++k)
+         pump (100);
+      if (!ended)
+      {
+         logE << "Headless: timed out waiting for end of input" << std::endl;
+         closeFds ();
+         return 1;
+      }
+
+      closeFds ();
+      return 0;
+   }
+
+} // namespace zutty
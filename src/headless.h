@@ -0,0 +1,35 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "fontpack.h"
+
+/* Headless mode: render terminal output read from a file to an offscreen
+ * EGL surface, without any X server. Meant for fast, pixel-exact
+ * regression testing of the terminal emulation and rendering.
+ *
+ * The input is fed to the terminal as if written by a program running
+ * in it. Sync points are marked in the input with the private escape
+ * sequence OSC 120 ; <name> BEL (or ST). At each sync point, the screen
+ * is rendered and a line "<name> <hash>" is printed on stdout, where
+ * <hash> is a 64-bit FNV-1a hash of the RGB pixel data. If <name> ends
+ * with ".ppm", the image is also written to that file. A last sync point
+ * named "end" is implied at the end of input (so that name is reserved).
+ */
+namespace zutty
+{
+   constexpr const int oscSyncPoint = 120;
+
+   // Run headless on inputPath ("-" for stdin); returns the exit code
+   int runHeadless (Fontpack* fontpk, const char* inputPath);
+
+} // namespace zutty
@@ -0,0 +1,166 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "hud.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+namespace
+{
+   std::string
+   format (const char* fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+   std::string
+   format (const char* fmt, ...)
+   {
+      char buf [64];
+      va_list ap;
+      va_start (ap, fmt);
+      vsnprintf (buf, sizeof (buf), fmt, ap);
+      va_end (ap);
+      return buf;
+   }
+
+   std::string
+   formatRate (double bytesPerSec)
+   {
+      if (bytesPerSec >= 1024 * 1024)
+         return format ("%.1f MB/s", bytesPerSec / (1024 * 1024));
+      if (bytesPerSec >= 1024)
+         return format ("%.1f kB/s", bytesPerSec / 1024);
+      return format ("%.0f B/s", bytesPerSec);
+   }
+
+} // namespace
+
+namespace zutty
+{
+   Hud::InputStats Hud::input;
+   constexpr const std::chrono::milliseconds Hud::refreshInterval;
+
+   Hud::Hud ()
+      : lastRefresh (Clock::now ())
+      , lines {" HUD: measuring...", "", ""}
+   {
+      input.ptyBytes = 0;
+      input.parseNanos = 0;
+      input.parseBatches = 0;
+      input.enabled = true;
+   }
+
+   Hud::~Hud ()
+   {
+      input.enabled = false;
+   }
+
+   void
+   Hud::frameDrawn (bool delta, Clock::duration renderTime)
+   {
+      using namespace std::chrono;
+      ++nFrames;
+      if (delta)
+         ++nDeltaFrames;
+      frameTimes [nextFrameTime] = duration_cast <microseconds> (
+         renderTime).count ();
+      nextFrameTime = (nextFrameTime + 1) % nFrameTimes;
+      nFrameTimesKept = std::min (nFrameTimesKept + 1, (uint32_t)nFrameTimes);
+   }
+
+   bool
+   Hud::update ()
+   {
+      using namespace std::chrono;
+      const Clock::time_point now = Clock::now ();
+      if (now - lastRefresh < refreshInterval)
+         return false;
+
+      const double secs = duration <double> (now - lastRefresh).count ();
+      lastRefresh = now;
+
+      // Render times of the last frames (not only since last refresh),
+      // so that the tail percentiles do not jump around too much
+      double p50 = 0, p90 = 0, p99 = 0;
+      if (nFrameTimesKept)
+      {
+         std::vector <uint32_t> t (frameTimes.begin (),
+                                   frameTimes.begin () + nFrameTimesKept);
+         auto percentile = [&] (int p)
+         {
+            auto nth = t.begin () + (t.size () - 1) * p / 100;
+            std::nth_element (t.begin (), nth, t.end ());
+            return *nth / 1000.0;
+         };
+         p50 = percentile (50);
+         p90 = percentile (90);
+         p99 = percentile (99);
+      }
+
+      const uint64_t ptyBytes = input.ptyBytes.exchange (0);
+      const uint64_t parseNanos = input.parseNanos.exchange (0);
+      const uint32_t parseBatches = input.parseBatches.exchange (0);
+
+      lines [0] = format (" %5.1f fps, %3u%% delta frames",
+                          nFrames / secs,
+                          nFrames ? 100 * nDeltaFrames / nFrames : 100);
+      lines [1] = format (" render p50/90/99 %.2f/%.2f/%.2f ms",
+                          p50, p90, p99);
+      lines [2] = " pty " + formatRate (ptyBytes / secs) +
+                  format (", parse %.2f ms", parseBatches
+                          ? parseNanos / 1e6 / parseBatches : 0.0);
+      nFrames = 0;
+      nDeltaFrames = 0;
+      dirty = true;
+      return true;
+   }
+
+   void
+   Hud::setGpuTimes (const std::vector <std::string>& gpuTimes)
+   {
+      lines.resize (nFigureLines);
+      for (const auto& line: gpuTimes)
+         lines.push_back (" " + line);
+      dirty = true;
+   }
+
+   Rect
+   Hud::draw (CharVdev::Cell* cells, uint16_t nCols, uint16_t nRows)
+   {
+      const int x0 = std::max (0, nCols - width);
+      const int rows = std::min ((int)lines.size (), (int)nRows);
+
+      for (int y = 0; y < rows; ++y)
+      {
+         CharVdev::Cell* row = cells + y * nCols;
+         // The left half of a double-width character is drawn without
+         // its right half, so make sure it gets drawn again
+         if (x0 > 0 && row [x0 - 1].dwidth)
+            row [x0 - 1].dirty = 1;
+
+         for (int x = x0; x < nCols; ++x)
+         {
+            const size_t k = x - x0;
+            CharVdev::Cell cell;
+            cell.uc_pt = k < lines [y].size () ? lines [y][k] : ' ';
+            cell.inverse = 1;
+            if (row [x] != cell)
+            {
+               row [x] = cell;
+               row [x].dirty = 1;
+            }
+         }
+      }
+      dirty = false;
+      return Rect (x0, 0, nCols, rows - 1);
+   }
+
+} // namespace zutty
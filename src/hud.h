@@ -0,0 +1,91 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "charvdev.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zutty
+{
+   /* Performance heads-up display, drawn by the Renderer over the cells
+    * in the top right corner of the window. It shows the frame rate, the
+    * percentiles of the render time of frames, the share of delta frames,
+    * the throughput of pty reads and the time spent parsing them, as well
+    * as the GPU time of the passes of rendering (with -gpuTimers).
+    *
+    * The Renderer keeps a Hud only while it is shown; the input side
+    * counters are updated only while enabled, so it costs nothing when
+    * it is off.
+    */
+   class Hud
+   {
+   public:
+      using Clock = std::chrono::steady_clock;
+
+      // Input side counters, updated by the Vterms (in the main thread)
+      struct InputStats
+      {
+         std::atomic <bool> enabled {false};
+         std::atomic <uint64_t> ptyBytes {0};
+         std::atomic <uint64_t> parseNanos {0};
+         std::atomic <uint32_t> parseBatches {0};
+      };
+      static InputStats input;
+
+      // How often the figures are refreshed (also when no frames come)
+      static constexpr const std::chrono::milliseconds refreshInterval {500};
+
+      Hud ();
+      ~Hud ();
+
+      // Account for a frame drawn (and presented) in renderTime
+      void frameDrawn (bool delta, Clock::duration renderTime);
+
+      // Refresh the figures if refreshInterval has passed since last time;
+      // returns whether they have been refreshed
+      bool update ();
+
+      // Show these lines (GpuTimer::summary) below the figures
+      void setGpuTimes (const std::vector <std::string>& gpuTimes);
+
+      // Whether the text has been refreshed since it was last drawn
+      bool changed () const { return dirty; }
+
+      /* Write the HUD into the cells of the vdev mapping (nCols x nRows),
+       * marking changed cells dirty; returns the damaged cells.
+       */
+      Rect draw (CharVdev::Cell* cells, uint16_t nCols, uint16_t nRows);
+
+   private:
+      static constexpr const int width = 40; // cells, including padding
+      static constexpr const int nFrameTimes = 256;
+
+      Clock::time_point lastRefresh;
+      uint32_t nFrames = 0;
+      uint32_t nDeltaFrames = 0;
+      std::array <uint32_t, nFrameTimes> frameTimes; // microseconds
+      uint32_t nFrameTimesKept = 0;
+      uint32_t nextFrameTime = 0;
+
+      static constexpr const int nFigureLines = 3;
+
+      std::vector <std::string> lines; // figures, then GPU times
+      bool dirty = true;
+   };
+
+} // namespace zutty
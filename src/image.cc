@@ -0,0 +1,442 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "base64.h"
+#include "image.h"
+#include "log.h"
+
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+   using namespace zutty;
+
+   size_t
+   imageBytes (const ImagePtr& image)
+   {
+      return image->rgba.size ();
+   }
+
+   bool
+   hasPrefix (const std::string& s, const char* prefix)
+   {
+      return s.compare (0, strlen (prefix), prefix) == 0;
+   }
+
+   // Resolve path past all symlinks; empty if it does not exist
+   std::string
+   resolvePath (const std::string& path)
+   {
+      char* resolved = realpath (path.c_str (), nullptr);
+      if (!resolved)
+         return std::string ();
+      std::string ret (resolved);
+      free (resolved);
+      return ret;
+   }
+
+   // Whether the resolved directory dir is (below) the directory top
+   bool
+   isBelow (const std::string& dir, const char* top)
+   {
+      if (!top || !*top)
+         return false;
+      std::string realTop = resolvePath (top);
+      if (realTop.empty ())
+         return false;
+      if (realTop.back () != '/')
+         realTop += '/';
+      return hasPrefix (dir + '/', realTop.c_str ());
+   }
+
+   // Copy the part of [data, data + len) selected by offset and size
+   bool
+   extract (const uint8_t* data, size_t len, const KittyCommand& cmd,
+            std::string& bytes, std::string& error)
+   {
+      if (cmd.offset > len)
+      {
+         error = "EINVAL:offset beyond end of data";
+         return false;
+      }
+      len -= cmd.offset;
+      if (cmd.size)
+      {
+         if (cmd.size > len)
+         {
+            error = "ENODATA:size beyond end of data";
+            return false;
+         }
+         len = cmd.size;
+      }
+      if (len > maxImageBytes)
+      {
+         error = "EFBIG:image data too large";
+         return false;
+      }
+      bytes.assign (reinterpret_cast <const char*> (data + cmd.offset), len);
+      return true;
+   }
+
+   bool
+   readFile (const std::string& path, const KittyCommand& cmd,
+             std::string& bytes, std::string& error)
+   {
+      // Check where the path really leads to, past any symlinks
+      const std::string realPath = resolvePath (path);
+      if (realPath.empty ())
+      {
+         error = std::string ("ENOENT:") + strerror (errno);
+         return false;
+      }
+      if (hasPrefix (realPath, "/proc/") || hasPrefix (realPath, "/sys/") ||
+          (hasPrefix (realPath, "/dev/") && !hasPrefix (realPath, "/dev/shm/")))
+      {
+         error = "EPERM:refusing to read from " + path;
+         return false;
+      }
+
+      // Never block on opening (e.g., a FIFO); only regular files are read
+      int flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+      if (cmd.medium == 't')
+      {
+         // Temporary files are deleted after reading, so be picky: the
+         // file itself must not be a symlink, and its resolved directory
+         // must be one of the temporary directories.
+         const size_t slash = path.rfind ('/');
+         const std::string name =
+            slash == std::string::npos ? path : path.substr (slash + 1);
+         const std::string dir = resolvePath (
+            slash == std::string::npos ? std::string (".") :
+            slash == 0 ? std::string ("/") : path.substr (0, slash));
+         const std::string file = (dir == "/" ? "" : dir) + "/" + name;
+         if (dir.empty () || file != realPath ||
+             name.find ("tty-graphics-protocol") == std::string::npos ||
+             !(isBelow (dir, "/tmp") || isBelow (dir, "/dev/shm") ||
+               isBelow (dir, getenv ("TMPDIR"))))
+         {
+            error = "EPERM:not a temporary file: " + path;
+            return false;
+         }
+         flags |= O_NOFOLLOW;
+      }
+
+      int fd = open (realPath.c_str (), flags);
+      if (fd < 0)
+      {
+         error = std::string ("ENOENT:") + strerror (errno);
+         return false;
+      }
+
+      struct stat st;
+      bool ok = false;
+      if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode))
+         error = "EINVAL:not a regular file: " + path;
+      else if (st.st_size == 0)
+         error = "ENODATA:empty file: " + path;
+      else
+      {
+         void* p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (p == MAP_FAILED)
+            error = std::string ("EIO:") + strerror (errno);
+         else
+         {
+            ok = extract (static_cast <const uint8_t*> (p), st.st_size, cmd,
+                          bytes, error);
+            munmap (p, st.st_size);
+         }
+      }
+      close (fd);
+
+      if (cmd.medium == 't')
+         unlink (realPath.c_str ());
+      return ok;
+   }
+
+   bool
+   readSharedMemory (std::string name, const KittyCommand& cmd,
+                     std::string& bytes, std::string& error)
+   {
+      if (name.empty () || name [0] != '/')
+         name = "/" + name;
+
+      int fd = shm_open (name.c_str (), O_RDONLY, 0);
+      if (fd < 0)
+      {
+         error = std::string ("ENOENT:") + strerror (errno);
+         return false;
+      }
+
+      struct stat st;
+      bool ok = false;
+      if (fstat (fd, &st) < 0 || st.st_size == 0)
+         error = "ENODATA:empty shared memory object: " + name;
+      else
+      {
+         void* p = mmap (nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+         if (p == MAP_FAILED)
+            error = std::string ("EIO:") + strerror (errno);
+         else
+         {
+            ok = extract (static_cast <const uint8_t*> (p), st.st_size, cmd,
+                          bytes, error);
+            munmap (p, st.st_size);
+         }
+      }
+      close (fd);
+
+      // The terminal owns the object once it has been transmitted
+      shm_unlink (name.c_str ());
+      return ok;
+   }
+
+   bool
+   decodeRaw (const std::string& bytes, const KittyCommand& cmd,
+              Image& image, std::string& error)
+   {
+      const int bpp = cmd.format == 24 ? 3 : 4;
+      if (cmd.width == 0 || cmd.height == 0)
+      {
+         error = "EINVAL:image size not specified";
+         return false;
+      }
+      if (cmd.width > maxImageSize || cmd.height > maxImageSize)
+      {
+         error = "EFBIG:image too large";
+         return false;
+      }
+      const size_t nPixels = cmd.width * cmd.height;
+      if (bytes.size () < nPixels * bpp)
+      {
+         error = "ENODATA:insufficient image data";
+         return false;
+      }
+
+      image.width = cmd.width;
+      image.height = cmd.height;
+      if (bpp == 4)
+      {
+         image.rgba.assign (bytes.begin (), bytes.begin () + nPixels * 4);
+         return true;
+      }
+
+      image.rgba.resize (nPixels * 4);
+      const uint8_t* src = reinterpret_cast <const uint8_t*> (bytes.data ());
+      uint8_t* dst = image.rgba.data ();
+      for (size_t k = 0; k < nPixels; ++k, src += 3, dst += 4)
+      {
+         dst [0] = src [0];
+         dst [1] = src [1];
+         dst [2] = src [2];
+         dst [3] = 255;
+      }
+      return true;
+   }
+
+   bool
+   decodePNG (const std::string& bytes, Image& image, std::string& error)
+   {
+#ifdef HAVE_LIBPNG
+      png_image png;
+      memset (&png, 0, sizeof (png));
+      png.version = PNG_IMAGE_VERSION;
+      if (!png_image_begin_read_from_memory (&png, bytes.data (),
+                                             bytes.size ()))
+      {
+         error = std::string ("EBADPNG:") + png.message;
+         return false;
+      }
+      if (png.width > maxImageSize || png.height > maxImageSize)
+      {
+         png_image_free (&png);
+         error = "EFBIG:image too large";
+         return false;
+      }
+
+      png.format = PNG_FORMAT_RGBA;
+      image.width = png.width;
+      image.height = png.height;
+      image.rgba.resize (PNG_IMAGE_SIZE (png));
+      if (!png_image_finish_read (&png, nullptr, image.rgba.data (), 0,
+                                  nullptr))
+      {
+         error = std::string ("EBADPNG:") + png.message;
+         return false;
+      }
+      return true;
+#else
+      error = "EINVAL:PNG not supported (built without libpng)";
+      return false;
+#endif
+   }
+
+} // namespace
+
+namespace zutty
+{
+   ImagePtr
+   ImageStore::get (uint32_t id) const
+   {
+      for (const auto& image: images)
+         if (image->id == id)
+            return image;
+      return nullptr;
+   }
+
+   void
+   ImageStore::put (const ImagePtr& image)
+   {
+      remove (image->id);
+      images.push_back (image);
+      totalBytes += imageBytes (image);
+      while (totalBytes > imageQuota && images.size () > 1)
+      {
+         logT << "ImageStore: evicting image " << images.front ()->id
+              << std::endl;
+         totalBytes -= imageBytes (images.front ());
+         images.pop_front ();
+      }
+   }
+
+   void
+   ImageStore::remove (uint32_t id)
+   {
+      for (auto it = images.begin (); it != images.end (); ++it)
+         if ((*it)->id == id)
+         {
+            totalBytes -= imageBytes (*it);
+            images.erase (it);
+            return;
+         }
+   }
+
+   void
+   ImageStore::clear ()
+   {
+      images.clear ();
+      totalBytes = 0;
+   }
+
+   bool
+   KittyCommand::parse (const std::string& arg)
+   {
+      const size_t semi = arg.find (';');
+      const std::string control = arg.substr (0, semi);
+      if (semi != std::string::npos)
+         payload = arg.substr (semi + 1);
+
+      size_t pos = 0;
+      while (pos < control.size ())
+      {
+         size_t end = control.find (',', pos);
+         if (end == std::string::npos)
+            end = control.size ();
+         if (end - pos < 3 || control [pos + 1] != '=')
+            return false;
+
+         const char key = control [pos];
+         const std::string value = control.substr (pos + 2, end - pos - 2);
+         pos = end + 1;
+
+         switch (key)
+         {
+         case 'a': action = value [0]; continue;
+         case 't': medium = value [0]; continue;
+         case 'd': deleteWhat = value [0]; continue;
+         case 'o': compression = value [0]; continue;
+         default: break;
+         }
+
+         char* endp;
+         long num = strtol (value.c_str (), &endp, 10);
+         if (*endp != '\0')
+            return false;
+         const uint32_t u = num < 0 ? 0 : num;
+
+         switch (key)
+         {
+         case 'f': format = u; break;
+         case 'i': imageId = u; break;
+         case 'p': placementId = u; break;
+         case 's': width = u; break;
+         case 'v': height = u; break;
+         case 'S': size = u; break;
+         case 'O': offset = u; break;
+         case 'x': srcX = u; break;
+         case 'y': srcY = u; break;
+         case 'w': srcW = u; break;
+         case 'h': srcH = u; break;
+         case 'c': cols = u; break;
+         case 'r': rows = u; break;
+         case 'q': quiet = u; break;
+         case 'm': more = (u == 1); break;
+         case 'C': noCursorMove = (u == 1); break;
+         default:
+            logT << "Kitty graphics: ignoring key " << key << std::endl;
+            break;
+         }
+      }
+      return true;
+   }
+
+   ImagePtr
+   loadKittyImage (const KittyCommand& cmd, std::string& error)
+   {
+      if (cmd.format != 24 && cmd.format != 32 && cmd.format != 100)
+      {
+         error = "EINVAL:unknown format";
+         return nullptr;
+      }
+      if (cmd.compression)
+      {
+         error = "EINVAL:compression not supported";
+         return nullptr;
+      }
+
+      const std::string data = base64::decode (cmd.payload);
+      std::string fromMedium;
+      const std::string* bytes = &data;
+      bool ok = true;
+      switch (cmd.medium)
+      {
+      case 'd': break;
+      case 'f': // fall through
+      case 't': ok = readFile (data, cmd, fromMedium, error); break;
+      case 's': ok = readSharedMemory (data, cmd, fromMedium, error); break;
+      default:
+         error = "EINVAL:unknown transmission medium";
+         return nullptr;
+      }
+      if (!ok)
+         return nullptr;
+      if (cmd.medium != 'd')
+         bytes = &fromMedium;
+
+      auto image = std::make_shared <Image> ();
+      image->id = cmd.imageId;
+      if (cmd.format == 100)
+         ok = decodePNG (*bytes, *image, error);
+      else
+         ok = decodeRaw (*bytes, cmd, *image, error);
+
+      return ok ? image : nullptr;
+   }
+
+} // namespace zutty
@@ -0,0 +1,134 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "base.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zutty
+{
+   // Decoded image: RGBA, 8 bits per channel, non-premultiplied alpha
+   struct Image
+   {
+      uint32_t id = 0;
+      uint16_t width = 0;
+      uint16_t height = 0;
+      std::vector <uint8_t> rgba;
+   };
+   using ImagePtr = std::shared_ptr <const Image>;
+
+   constexpr const int maxImageSize = 8192; // in pixels, in both directions
+   constexpr const size_t maxImageBytes = 4ul * maxImageSize * maxImageSize;
+
+   // Limit of the total size of stored images, and separately, of images
+   // placed on a Frame (including its scrollback history)
+   constexpr const size_t imageQuota = 256 * 1024 * 1024;
+
+   /* An image shown on the screen. It is anchored to the cell at its top
+    * left corner, and occupies the cells under it (cols x rows), although
+    * the image itself need not be scaled to fill them.
+    */
+   struct ImagePlacement
+   {
+      ImagePtr image;
+      uint32_t placementId = 0;
+      int row = 0;         // in the Frame: screen row (negative: history);
+                           // as passed to the vdev: view row
+      uint16_t col = 0;
+      uint16_t cols = 0;   // cells occupied
+      uint16_t rows = 0;
+      uint16_t width = 0;  // size on screen, in pixels
+      uint16_t height = 0;
+      Rect src;            // source rectangle in image pixels
+
+      // The cells occupied, as a damage rectangle (bottom row inclusive)
+      Rect cellRect () const
+      {
+         return Rect (col, row, col + cols, row + rows - 1);
+      }
+
+      bool operator == (const ImagePlacement& rhs) const
+      {
+         return image == rhs.image && row == rhs.row && col == rhs.col &&
+                width == rhs.width && height == rhs.height && src == rhs.src;
+      }
+
+      bool operator != (const ImagePlacement& rhs) const
+      {
+         return ! operator == (rhs);
+      }
+   };
+
+   /* Images transmitted by the program running in the terminal, by id.
+    * Images still placed on the screen are kept alive by their placements
+    * even after being dropped from here, either explicitly or to keep the
+    * total size within quota (oldest first).
+    */
+   class ImageStore
+   {
+   public:
+      ImagePtr get (uint32_t id) const;
+      void put (const ImagePtr& image);
+      void remove (uint32_t id);
+      void clear ();
+
+   private:
+      std::list <ImagePtr> images; // in order of transmission
+      size_t totalBytes = 0;
+   };
+
+   /* Kitty graphics protocol command: APC G <control data> ; <payload> ST
+    * Only the parts relevant to transmitting, placing and deleting images
+    * are supported (no animation, no unicode placeholders, no z-index).
+    */
+   struct KittyCommand
+   {
+      char action = 't';        // a=
+      char medium = 'd';        // t=
+      char deleteWhat = 'a';    // d=
+      char compression = '\0';  // o=
+      uint32_t format = 32;     // f=
+      uint32_t imageId = 0;     // i=
+      uint32_t placementId = 0; // p=
+      uint32_t width = 0;       // s=
+      uint32_t height = 0;      // v=
+      uint32_t size = 0;        // S=
+      uint32_t offset = 0;      // O=
+      uint32_t srcX = 0;        // x=
+      uint32_t srcY = 0;        // y=
+      uint32_t srcW = 0;        // w=
+      uint32_t srcH = 0;        // h=
+      uint32_t cols = 0;        // c=
+      uint32_t rows = 0;        // r=
+      uint32_t quiet = 0;       // q=
+      bool more = false;        // m=1
+      bool noCursorMove = false;// C=1
+      std::string payload;
+
+      // Parse arg (excluding the leading G); returns false if malformed
+      bool parse (const std::string& arg);
+   };
+
+   /* Load the image of a transmit or query command from its (base64
+    * encoded) payload. The image bytes come either from the payload itself
+    * (direct transmission) or from the file or shared memory object named
+    * by it, so they do not need to pass through the pty at all.
+    * On failure, return nullptr and set error to a protocol error string.
+    */
+   ImagePtr loadKittyImage (const KittyCommand& cmd, std::string& error);
+
+} // namespace zutty
@@ -11,8 +11,10 @@
 
 #include "log.h"
 
+#include <algorithm>
 #include <string.h>
 #include <unistd.h>
+#include <vector>
 
 namespace zutty
 {
@@ -54,4 +56,91 @@ namespace zutty
          close (fd);
    }
 
+   constexpr const std::chrono::seconds DiagCounter::reportInterval;
+   constexpr const int DiagCounter::nTopKeys;
+   constexpr const int DiagCounter::nSlots;
+
+   DiagCounter::DiagCounter (const char* what_, bool isError_,
+                             const DescribeFn& describe_)
+      : what (what_)
+      , isError (isError_)
+      , describe (describe_)
+   {}
+
+   DiagCounter::~DiagCounter ()
+   {
+      spillAll ();
+      if (!counts.empty ())
+         report ();
+   }
+
+   int
+   DiagCounter::flush ()
+   {
+      spillAll ();
+      if (counts.empty ())
+         return -1;
+
+      using namespace std::chrono;
+      auto now = Clock::now ();
+      if (now < due)
+         return 1 + duration_cast <milliseconds> (due - now).count ();
+
+      report ();
+      return -1;
+   }
+
+   void
+   DiagCounter::spillAll ()
+   {
+      for (Slot& s: slots)
+         if (s.count)
+            spill (s);
+   }
+
+   void
+   DiagCounter::report ()
+   {
+      using namespace std::chrono;
+      const auto now = Clock::now ();
+      const auto sinceLast = now - (due - reportInterval);
+      due = now + reportInterval;
+
+      std::vector <std::pair <uint32_t, uint32_t>> top (counts.begin (),
+                                                        counts.end ());
+      counts.clear ();
+      uint64_t total = 0;
+      for (const auto& c: top)
+         total += c.second;
+      const int n = std::min ((int)top.size (), nTopKeys);
+      std::partial_sort (top.begin (), top.begin () + n, top.end (),
+                         [] (const std::pair <uint32_t, uint32_t>& a,
+                             const std::pair <uint32_t, uint32_t>& b)
+                         { return a.second > b.second; });
+
+      std::ostringstream oss;
+      oss << what << ": ";
+      if (total == 1)
+         oss << describe (top [0].first);
+      else
+      {
+         // Only a steady stream has a meaningful interval to report
+         oss << total << " times";
+         if (sinceLast <= 2 * reportInterval)
+            oss << " in " << duration_cast <milliseconds> (sinceLast).count ()
+                << " ms";
+         oss << ":";
+         for (int k = 0; k < n; ++k)
+            oss << (k ? ", " : " ") << describe (top [k].first)
+                << " (" << top [k].second << ")";
+         if ((int)top.size () > n)
+            oss << " and " << top.size () - n << " more";
+      }
+
+      if (isError)
+         logE << oss.str () << std::endl;
+      else
+         logU << oss.str () << std::endl;
+   }
+
 } // namespace zutty
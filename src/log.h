@@ -13,9 +13,14 @@
 
 #include "options.h"
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <unordered_map>
 
 namespace zutty
 {
@@ -125,4 +130,67 @@ namespace zutty
          return "";
    }
 
+   /* Diagnostics that the input can trigger at will (e.g., by cat-ing a
+    * binary file) are counted by a key (e.g., parser state and offending
+    * byte) instead of each logging a line, and logged in summary at most
+    * once per reportInterval, by flush (). The first one after a quiet
+    * interval is logged by the next flush.
+    *
+    * Counting is meant to be cheap enough for every byte of a flood: it
+    * only increments a slot of a small direct-mapped table, which is
+    * moved to the map of all counts on collisions and by flush ().
+    */
+   class DiagCounter
+   {
+   public:
+      using Clock = std::chrono::steady_clock;
+      using DescribeFn = std::function <std::string (uint32_t key)>;
+
+      static constexpr const std::chrono::seconds reportInterval {1};
+
+      // Logged as "<what>: <count> times..." (as an error if isError),
+      // describe returns the text for a key
+      DiagCounter (const char* what, bool isError, const DescribeFn& describe);
+      ~DiagCounter (); // log what is left
+
+      void count (uint32_t key)
+      {
+         Slot& s = slots [(key ^ (key >> 8) ^ (key >> 16)) % nSlots];
+         if (s.count && s.key != key)
+            spill (s);
+         s.key = key;
+         ++s.count;
+      }
+
+      /* Log the counts if due; returns the time in ms until they will be
+       * (suitable as a poll timeout), or -1 if there is nothing to log.
+       */
+      int flush ();
+
+   private:
+      static constexpr const int nTopKeys = 4; // listed in a report
+      static constexpr const int nSlots = 64;
+
+      struct Slot
+      {
+         uint32_t key = 0;
+         uint32_t count = 0;
+      };
+
+      const char* what;
+      bool isError;
+      DescribeFn describe;
+      Slot slots [nSlots];
+      std::unordered_map <uint32_t, uint32_t> counts;
+      Clock::time_point due;
+
+      void spill (Slot& s)
+      {
+         counts [s.key] += s.count;
+         s.count = 0;
+      }
+      void spillAll ();
+      void report ();
+   };
+
 } // namespace zutty
@@ -18,12 +18,18 @@
 #include "base.h"
 #include "base64.h"
 #include "fontpack.h"
+#include "headless.h"
 #include "options.h"
+#include "probe.h"
 #include "pty.h"
 #include "renderer.h"
 #include "selmgr.h"
+#include "server.h"
 #include "vterm.h"
 #include "wm_icons.h"
+#include "workspace.h"
+
+#include <EGL/eglext.h>
 
 #include <cassert>
 #include <langinfo.h>
@@ -38,7 +44,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+using zutty::DiagCounter;
 using zutty::Fontpack;
+using zutty::FramePacer;
 using zutty::MouseTrackingState;
 using zutty::MouseTrackingMode;
 using zutty::MouseTrackingEnc;
@@ -47,17 +55,25 @@ using zutty::VtKey;
 using zutty::VtModifier;
 using zutty::Renderer;
 using zutty::SelectionManager;
+using zutty::Workspace;
 
 static std::unique_ptr <Fontpack> fontpk = nullptr;
 static std::unique_ptr <Renderer> renderer = nullptr;
-static std::unique_ptr <Vterm> vt = nullptr;
 static std::unique_ptr <SelectionManager> selMgr = nullptr;
+static std::unique_ptr <Workspace> workspace = nullptr;
+static Vterm* vt = nullptr; // the focused terminal of the workspace
 
 static Display* xDisplay = nullptr;
 static Window xWindow;
 static Atom wmDeleteMessage;
 static XSizeHints sizeHints;
 static Colormap colormap;
+static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamage = nullptr;
+
+// EGL_CHROMIUM_sync_control (not in the Khronos headers)
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLGETSYNCVALUESCHROMIUMPROC)
+   (EGLDisplay dpy, EGLSurface surface, EGLuint64KHR* ust,
+    EGLuint64KHR* msc, EGLuint64KHR* sbc);
 
 static void
 convertColor (const zutty::Color& color, XColor& xcolor)
@@ -157,22 +173,37 @@ makeXWindow (const char* name, int width, int height, int px, int py,
 
    root = RootWindow (xDisplay, DefaultScreen (xDisplay));
 
-   if (!eglChooseConfig (eglDpy, eglAttrs, &config, 1, &numConfigs)) {
-      logE << "Couldn't get an EGL visual config" << std::endl;
-      exit(1);
-   }
+   if (eglDpy != EGL_NO_DISPLAY)
+   {
+      if (!eglChooseConfig (eglDpy, eglAttrs, &config, 1, &numConfigs)) {
+         logE << "Couldn't get an EGL visual config" << std::endl;
+         exit(1);
+      }
 
-   assert (config);
-   assert (numConfigs > 0);
+      assert (config);
+      assert (numConfigs > 0);
 
-   if (!eglGetConfigAttrib (eglDpy, config, EGL_NATIVE_VISUAL_ID, &vid)) {
-      logE << "eglGetConfigAttrib() failed" << std::endl;
-      exit (1);
-   }
+      if (!eglGetConfigAttrib (eglDpy, config, EGL_NATIVE_VISUAL_ID, &vid)) {
+         logE << "eglGetConfigAttrib() failed" << std::endl;
+         exit (1);
+      }
 
-   // The X window visual must match the EGL config
-   visTemplate.visualid = vid;
-   visInfo = XGetVisualInfo (xDisplay, VisualIDMask, &visTemplate, &numVisuals);
+      // The X window visual must match the EGL config
+      visTemplate.visualid = vid;
+      visInfo = XGetVisualInfo (xDisplay, VisualIDMask, &visTemplate,
+                                &numVisuals);
+   }
+   else
+   {
+      // Software rendering: any 24-bit TrueColor visual will do
+      visTemplate.screen = DefaultScreen (xDisplay);
+      visTemplate.depth = 24;
+      visTemplate.c_class = TrueColor;
+      visInfo = XGetVisualInfo (xDisplay,
+                                VisualScreenMask | VisualDepthMask |
+                                VisualClassMask,
+                                &visTemplate, &numVisuals);
+   }
    if (!visInfo) {
       logE << "Couldn't get X visual" << std::endl;
       exit (1);
@@ -185,7 +216,7 @@ makeXWindow (const char* name, int width, int height, int px, int py,
    attr.colormap = colormap;
    attr.event_mask = StructureNotifyMask | ExposureMask | FocusChangeMask |
       PropertyChangeMask | KeyPressMask | ButtonPressMask | ButtonReleaseMask |
-      PointerMotionMask;
+      PointerMotionMask | VisibilityChangeMask;
    mask = CWBackPixel | CWBorderPixel | CWColormap | CWEventMask;
 
    xWindow = XCreateWindow (xDisplay, root, 0, 0, width, height,
@@ -246,6 +277,13 @@ makeXWindow (const char* name, int width, int height, int px, int py,
    wmDeleteMessage = XInternAtom (xDisplay, "WM_DELETE_WINDOW", False);
    XSetWMProtocols (xDisplay, xWindow, &wmDeleteMessage, 1);
 
+   if (eglDpy == EGL_NO_DISPLAY)
+   {
+      XFree (visInfo);
+      setXCursor ();
+      return;
+   }
+
    eglBindAPI (EGL_OPENGL_ES_API);
 
    eglCtx = eglCreateContext (eglDpy, config, EGL_NO_CONTEXT, ctxAttrs);
@@ -421,12 +459,13 @@ setupSignals ()
 }
 
 static int
-startShell (const char* execPath, const char* const argv[])
+startShell (const char* execPath, const char* const argv[],
+            uint16_t nCols, uint16_t nRows)
 {
    int ptyFd;
    pid_t pid;
 
-   pid = zutty::pty_fork (ptyFd, opts.nCols, opts.nRows);
+   pid = zutty::pty_fork (ptyFd, nCols, nRows);
 
    if (pid < 0)
    {
@@ -474,7 +513,7 @@ pasteCb (bool success, const std::string& content)
 }
 
 static bool
-onKeyPress (XEvent& event, XIC& xic, int ptyFd)
+onKeyPress (XEvent& event, XIC& xic)
 {
    using Key = VtKey;
    XKeyEvent& xkevt = event.xkey;
@@ -503,6 +542,7 @@ onKeyPress (XEvent& event, XIC& xic, int ptyFd)
    buffer [nbytes] = '\0';
 
    VtModifier mod = convertKeyState (ks, xkevt.state);
+   PROBE2 (key_press, ks, (int)mod);
 
    // Special key combinations that are handled by Zutty itself:
    if (ks == XK_Page_Up && mod == VtModifier::shift)
@@ -530,6 +570,46 @@ onKeyPress (XEvent& event, XIC& xic, int ptyFd)
       selMgr->getSelection (selMgr->getPrimary (), xkevt.time, pasteCb);
       return false;
    }
+   if (ks == XK_T && mod == VtModifier::shift_control)
+   {
+      workspace->newTab ();
+      return false;
+   }
+   if (ks == XK_Page_Up && mod == VtModifier::shift_control)
+   {
+      workspace->prevTab ();
+      return false;
+   }
+   if (ks == XK_Page_Down && mod == VtModifier::shift_control)
+   {
+      workspace->nextTab ();
+      return false;
+   }
+   if (ks == XK_E && mod == VtModifier::shift_control)
+   {
+      workspace->split (true);
+      return false;
+   }
+   if (ks == XK_O && mod == VtModifier::shift_control)
+   {
+      workspace->split (false);
+      return false;
+   }
+   if (ks == XK_N && mod == VtModifier::shift_control)
+   {
+      workspace->focusNext ();
+      return false;
+   }
+   if (ks == XK_P && mod == VtModifier::shift_control)
+   {
+      workspace->focusPrev ();
+      return false;
+   }
+   if (ks == XK_H && mod == VtModifier::shift_control)
+   {
+      renderer->toggleHud ();
+      return false;
+   }
    if ((ks == XK_space || ks == XK_KP_Space) &&
        (xkevt.state & (Button1Mask | Button3Mask)))
    {
@@ -731,6 +811,16 @@ struct MouseContext
 };
 static MouseContext mouseCtx;
 
+// Translate pointer coordinates to those of the focused pane, as if it
+// were the whole window
+static inline void
+toPaneCoords (int& x, int& y)
+{
+   const zutty::Point origin = workspace->getFocusedOrigin ();
+   x -= origin.x;
+   y -= origin.y;
+}
+
 static inline bool
 isMouseProtocol (unsigned int state, const MouseTrackingState& mouseTrk)
 {
@@ -894,6 +984,10 @@ onMotionNotifyMouseProto (XMotionEvent& xmoevt,
 static void
 onButtonPress (XButtonEvent& xbevt, bool& holdPtyIn)
 {
+   if (xbevt.button <= 3) // not on wheel scrolling
+      workspace->focusAt (xbevt.x, xbevt.y);
+   toPaneCoords (xbevt.x, xbevt.y);
+
    const auto& mouseTrk = vt->getMouseTrackingState ();
    if (isMouseProtocol (xbevt.state, mouseTrk))
    {
@@ -925,6 +1019,8 @@ onButtonPress (XButtonEvent& xbevt, bool& holdPtyIn)
 static void
 onButtonRelease (XButtonEvent& xbevt, bool& holdPtyIn)
 {
+   toPaneCoords (xbevt.x, xbevt.y);
+
    const auto& mouseTrk = vt->getMouseTrackingState ();
    if (isMouseProtocol (xbevt.state, mouseTrk))
    {
@@ -963,6 +1059,8 @@ onButtonRelease (XButtonEvent& xbevt, bool& holdPtyIn)
 static void
 onMotionNotify (XMotionEvent& xmoevt)
 {
+   toPaneCoords (xmoevt.x, xmoevt.y);
+
    const auto& mouseTrk = vt->getMouseTrackingState ();
    if (isMouseProtocol (xmoevt.state, mouseTrk))
       onMotionNotifyMouseProto (xmoevt, mouseTrk);
@@ -970,8 +1068,37 @@ onMotionNotify (XMotionEvent& xmoevt)
       vt->selectUpdate (xmoevt.x, xmoevt.y);
 }
 
+// Pause rendering while the window is unmapped or fully obscured
+static void
+onVisibilityChange (const XEvent& event)
+{
+   static bool mapped = true;
+   static int visibilityState = VisibilityUnobscured;
+
+   switch (event.type) {
+   case MapNotify:
+      logT << "MapNotify" << std::endl;
+      mapped = true;
+      break;
+   case UnmapNotify:
+      logT << "UnmapNotify" << std::endl;
+      mapped = false;
+      break;
+   case VisibilityNotify:
+      logT << "VisibilityNotify state=" << event.xvisibility.state
+           << std::endl;
+      visibilityState = event.xvisibility.state;
+      break;
+   default:
+      return;
+   }
+
+   workspace->setVisible (mapped &&
+                          visibilityState != VisibilityFullyObscured);
+}
+
 static bool
-x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
+x11Event (XEvent& event, XIC& xic, bool& destroyed, bool& holdPtyIn)
 {
    static bool exposed = false;
    bool redraw = false;
@@ -980,7 +1107,8 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
    switch (event.type) {
    case Expose:
       exposed = true;
-      redraw = true;
+      if (event.xexpose.count == 0)
+         workspace->expose ();
       break;
    case ClientMessage:
       if ((unsigned long) event.xclient.data.l [0] == wmDeleteMessage)
@@ -995,7 +1123,11 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       }
       break;
    case ConfigureNotify:
-      vt->resize (event.xconfigure.width, event.xconfigure.height);
+      // Skip to the latest geometry if more are queued (interactive resize)
+      while (XCheckTypedWindowEvent (xDisplay, xWindow, ConfigureNotify,
+                                     &event))
+         ;
+      workspace->resize (event.xconfigure.width, event.xconfigure.height);
       if (sizeHints.width != event.xconfigure.width ||
           sizeHints.height != event.xconfigure.height)
       {
@@ -1013,17 +1145,16 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       logT << "MappingNotify" << std::endl;
       break;
    case MapNotify:
-      logT << "MapNotify" << std::endl;
-      break;
    case UnmapNotify:
-      logT << "UnmapNotify" << std::endl;
+   case VisibilityNotify:
+      onVisibilityChange (event);
       break;
    case DestroyNotify:
       logT << "DestroyNotify" << std::endl;
       destroyed = true;
       return true;
    case KeyPress:
-      return onKeyPress (event, xic, ptyFd);
+      return onKeyPress (event, xic);
    case KeyRelease:
       break;
    case ButtonPress:
@@ -1033,17 +1164,23 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
       onButtonRelease (event.xbutton, holdPtyIn);
       break;
    case MotionNotify:
+      // Skip to the latest position if more motion is queued right after
+      // (but not past other events, e.g., a button release)
+      while (XEventsQueued (xDisplay, QueuedAlready))
+      {
+         XEvent next;
+         XPeekEvent (xDisplay, &next);
+         if (next.type != MotionNotify || next.xmotion.window != xWindow)
+            break;
+         XNextEvent (xDisplay, &event);
+      }
       onMotionNotify (event.xmotion);
       break;
    case FocusIn:
-      if (vt->getMouseTrackingState ().focusEventMode)
-         vt->writePty ("\e[I");
-      vt->setHasFocus (true);
+      workspace->setHasFocus (true);
       break;
    case FocusOut:
-      if (vt->getMouseTrackingState ().focusEventMode)
-         vt->writePty ("\e[O");
-      vt->setHasFocus (false);
+      workspace->setHasFocus (false);
       break;
    case PropertyNotify:
       selMgr->onPropertyNotify (event.xproperty);
@@ -1065,29 +1202,35 @@ x11Event (XEvent& event, XIC& xic, int ptyFd, bool& destroyed, bool& holdPtyIn)
    }
 
    if (exposed && redraw) {
-      vt->redraw ();
+      workspace->redraw ();
    }
 
    return false;
 }
 
+// Unhandled OSC commands (see handleOsc), logged in summary
+static DiagCounter unhandledOsc ("OSC", false, [] (uint32_t cmd)
+                                 { return std::to_string (cmd); });
+
 static bool
-eventLoop (XIC& xic, int ptyFd)
+eventLoop (XIC& xic)
 {
    int x11Fd = XConnectionNumber (xDisplay);
    logT << "x11Fd = " << x11Fd << std::endl;
-   logT << "ptyFd = " << ptyFd << std::endl;
 
-   struct pollfd pollset [] = {
-      {ptyFd, POLLIN, 0},
-      {x11Fd, POLLIN, 0},
-   };
+   // The X connection, followed by the ptys of all panes
+   std::vector <struct pollfd> pollset;
 
    bool holdPtyIn = false;
    while (1)
    {
-      pollset [0].fd = holdPtyIn ? -ptyFd : ptyFd;
-      if (poll (pollset, 2, -1) < 0)
+      pollset.assign (1, {x11Fd, POLLIN, 0});
+      workspace->addPollFds (pollset, holdPtyIn);
+      int timeout = workspace->runTimers ();
+      const int t = unhandledOsc.flush ();
+      if (t >= 0 && (timeout < 0 || t < timeout))
+         timeout = t;
+      if (poll (pollset.data (), pollset.size (), timeout) < 0)
       {
          if (errno == EINTR)
             continue;
@@ -1095,37 +1238,39 @@ eventLoop (XIC& xic, int ptyFd)
             return false;
       }
 
-      if (pollset [0].revents & (POLLIN | POLLHUP))
-         if (vt->readPty ())
-            return false;
+      if (!workspace->readPtys (pollset.data () + 1))
+         return false;
 
-      if (pollset [1].revents & POLLIN)
+      if (pollset [0].revents & POLLIN)
          while (XPending (xDisplay))
          {
             XEvent event;
             bool destroyed = false;
 
             XNextEvent (xDisplay, &event);
-            if (x11Event (event, xic, ptyFd, destroyed, holdPtyIn))
+            if (x11Event (event, xic, destroyed, holdPtyIn))
                return destroyed;
          }
    }
 }
 
 static void
-handleOsc (int cmd, const std::string& arg)
+handleOsc (const Vterm& term, int cmd, const std::string& arg)
 {
+   // The window title follows the focused pane (see Workspace::setTitle)
    switch (cmd)
    {
    case 0: // Change Icon Name & Window Title
-      setXWindowName (arg);
-      setXWindowIconName (arg);
+      workspace->setTitle (term, arg);
+      if (&term == vt)
+         setXWindowIconName (arg);
       break;
    case 1: // Change Icon Name
-      setXWindowIconName (arg);
+      if (&term == vt)
+         setXWindowIconName (arg);
       break;
    case 2: // Change Window Title
-      setXWindowName (arg);
+      workspace->setTitle (term, arg);
       break;
    case 52: // Manipulate Selection Data
    {
@@ -1190,11 +1335,58 @@ handleOsc (int cmd, const std::string& arg)
    }
       break;
    default:
-      logU << "unhandled OSC: '" << cmd << ";" << arg << "'" << std::endl;
+      logT << "unhandled OSC: '" << cmd << ";" << arg << "'" << std::endl;
+      unhandledOsc.count (cmd);
       break;
    }
 }
 
+static void
+setupSwapBuffersWithDamage (EGLDisplay eglDpy)
+{
+   std::string exts = eglQueryString (eglDpy, EGL_EXTENSIONS);
+   exts += " ";
+   if (exts.find ("EGL_KHR_swap_buffers_with_damage ") != std::string::npos)
+      eglSwapBuffersWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+         eglGetProcAddress ("eglSwapBuffersWithDamageKHR");
+   else if (exts.find ("EGL_EXT_swap_buffers_with_damage ") !=
+            std::string::npos)
+      eglSwapBuffersWithDamage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+         eglGetProcAddress ("eglSwapBuffersWithDamageEXT");
+
+   logI << "Swap buffers with damage: "
+        << (eglSwapBuffersWithDamage ? "supported" : "not supported")
+        << std::endl;
+}
+
+static std::unique_ptr <FramePacer>
+makeFramePacer (EGLDisplay eglDpy, EGLSurface eglSurface)
+{
+   std::string exts = eglQueryString (eglDpy, EGL_EXTENSIONS);
+   exts += " ";
+   PFNEGLGETSYNCVALUESCHROMIUMPROC eglGetSyncValues = nullptr;
+   if (exts.find ("EGL_CHROMIUM_sync_control ") != std::string::npos)
+      eglGetSyncValues = (PFNEGLGETSYNCVALUESCHROMIUMPROC)
+         eglGetProcAddress ("eglGetSyncValuesCHROMIUM");
+
+   logI << "Low latency mode, vblank timing: "
+        << (eglGetSyncValues ? "sync control" : "buffer swaps")
+        << std::endl;
+   if (!eglGetSyncValues)
+      return std::make_unique <FramePacer> ();
+
+   return std::make_unique <FramePacer> (
+      [eglDpy, eglSurface, eglGetSyncValues] (int64_t& ust, int64_t& msc)
+      {
+         EGLuint64KHR u, m, s;
+         if (!eglGetSyncValues (eglDpy, eglSurface, &u, &m, &s))
+            return false;
+         ust = u;
+         msc = m;
+         return true;
+      });
+}
+
 static void
 printGLInfo (EGLDisplay eglDpy)
 {
@@ -1261,51 +1453,15 @@ handleXIOError (Display* dpy)
    return 0;
 }
 
-int
-main (int argc, char* argv[])
+static int
+openDisplay (int* argc, char* argv[])
 {
-   EGLSurface eglSurface;
-   EGLContext eglCtx;
-   EGLDisplay eglDpy;
-   EGLint eglMajor, eglMinor;
-   XIC xic = nullptr;
-   XIM xim;
-   XIMStyles* ximStyles;
-   XIMStyle ximStyle = 0;
-   char* imvalret;
-   int i;
-
-   {
-      const char* loc;
-      bool warn = false;
-      loc = setlocale (LC_ALL, "");
-      if (!loc)
-      {
-         std::cout << "Warning: could not set locale!" << std::endl;
-         warn = true;
-      }
-      else if (strcmp (nl_langinfo (CODESET), "UTF-8") != 0)
-      {
-         std::cout << "Warning: non-UTF-8 locale: " << loc << std::endl;
-         warn = true;
-      }
-      if (warn)
-         std::cout << "Expect broken international characters "
-                   << "(or fix your locale)!"
-                   << std::endl;
-   }
-
-   if (! XInitThreads ())
+   opts.initialize (argc, argv);
+   if (opts.headless)
    {
-      std::cout << "Error: couldn't initialize XLib for multithreaded use"
-                << std::endl;
-      return -1;
+      opts.parse ();
+      return 0;
    }
-
-   XSetErrorHandler(handleXError);
-   XSetIOErrorHandler(handleXIOError);
-
-   opts.initialize (&argc, argv);
    if (!opts.display)
    {
       opts.handlePrintOpts ();
@@ -1325,11 +1481,22 @@ main (int argc, char* argv[])
 
    opts.parse ();
 
-   if (opts.verbose)
-      opts.printVersion ();
+   return 0;
+}
 
-   if (setenv ("ZUTTY_VERSION", ZUTTY_VERSION, 1) < 0)
-      SYS_ERROR ("setenv (ZUTTY_VERSION)");
+static int
+runWindow (int argc, char* argv[])
+{
+   EGLSurface eglSurface = EGL_NO_SURFACE;
+   EGLContext eglCtx = EGL_NO_CONTEXT;
+   EGLDisplay eglDpy;
+   EGLint eglMajor, eglMinor;
+   XIC xic = nullptr;
+   XIM xim;
+   XIMStyles* ximStyles;
+   XIMStyle ximStyle = 0;
+   char* imvalret;
+   int i;
 
    char argv0 [PATH_MAX];
    char progPath [PATH_MAX];
@@ -1355,18 +1522,27 @@ main (int argc, char* argv[])
       validateShell (progPath);
    }
 
-   eglDpy = eglGetDisplay ((EGLNativeDisplayType)xDisplay);
-   if (!eglDpy)
+   eglDpy = EGL_NO_DISPLAY;
+   if (!opts.software)
    {
-      logE << "eglGetDisplay() failed" << std::endl;
-      return -1;
-   }
-
-   if (!eglInitialize (eglDpy, &eglMajor, &eglMinor))
-   {
-      logE << "eglInitialize() failed" << std::endl;
-      return -1;
+      eglDpy = eglGetDisplay ((EGLNativeDisplayType)xDisplay);
+      if (eglDpy == EGL_NO_DISPLAY)
+      {
+         logW << "eglGetDisplay() failed, using software rendering"
+              << std::endl;
+      }
+      else if (!eglInitialize (eglDpy, &eglMajor, &eglMinor))
+      {
+         logW << "eglInitialize() failed, using software rendering"
+              << std::endl;
+         eglDpy = EGL_NO_DISPLAY;
+      }
+      else
+      {
+         setupSwapBuffersWithDamage (eglDpy);
+      }
    }
+   const bool software = (eglDpy == EGL_NO_DISPLAY);
 
    xim = XOpenIM (xDisplay, nullptr, nullptr, nullptr);
    if (xim == nullptr)
@@ -1402,9 +1578,6 @@ main (int argc, char* argv[])
       }
    }
 
-   fontpk = std::make_unique <Fontpack> (opts.fontpath, opts.fontname,
-                                         opts.dwfontname);
-
    int winWidth = 2 * opts.border + opts.nCols * fontpk->getPx ();
    int winHeight = 2 * opts.border + opts.nRows * fontpk->getPy ();
 
@@ -1426,7 +1599,8 @@ main (int argc, char* argv[])
       }
    }
 
-   if (!eglMakeCurrent(eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT))
+   if (!software &&
+       !eglMakeCurrent(eglDpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT))
    {
       logE << "eglMakeCurrent() failed" << std::endl;
       return -1;
@@ -1435,38 +1609,71 @@ main (int argc, char* argv[])
    selMgr = std::make_unique <SelectionManager> (xDisplay, xWindow);
 
    renderer = std::make_unique <Renderer> (
-      [eglDpy, eglSurface, eglCtx] ()
+      [software, eglDpy, eglSurface, eglCtx] ()
       {
+         if (software)
+            return;
          if (!eglMakeCurrent (eglDpy, eglSurface, eglSurface, eglCtx))
             throw std::runtime_error ("Error: eglMakeCurrent() failed");
+         // Frame pacing relies on swaps waiting for vblank
+         if (opts.lowLatency)
+            eglSwapInterval (eglDpy, 1);
          if (opts.glinfo)
             printGLInfo (eglDpy);
       },
-      [eglDpy, eglSurface] ()
+      [software, eglDpy, eglSurface] (const zutty::Rect& damage)
       {
-         eglSwapBuffers (eglDpy, eglSurface);
+         if (software)
+            return; // already presented by SoftVdev
+         PROBE (swap_begin);
+         if (eglSwapBuffersWithDamage && !damage.null ())
+         {
+            EGLint rect [4] = { damage.tl.x, damage.tl.y,
+                                damage.br.x - damage.tl.x,
+                                damage.br.y - damage.tl.y };
+            eglSwapBuffersWithDamage (eglDpy, eglSurface, rect, 1);
+         }
+         else
+            eglSwapBuffers (eglDpy, eglSurface);
+         PROBE (swap_end);
       },
-      fontpk.get ());
+      fontpk.get (), software ? xWindow : None,
+      opts.lowLatency && !software ? makeFramePacer (eglDpy, eglSurface)
+                                   : nullptr);
 
    setupSignals ();
-   int ptyFd = startShell (progPath, shArgv);
-   vt = std::make_unique <Vterm> (fontpk->getPx (), fontpk->getPy (),
-                                  winWidth, winHeight, ptyFd);
-   vt->setRefreshHandler ([] (const zutty::Frame& f) { renderer->update (f); });
-   vt->setOscHandler ([] (int cmd, const std::string& arg)
-                      { handleOsc (cmd, arg); });
-   vt->setBellHandler ([] () { XBell (xDisplay, 0); });
-
-   // We might not get a ConfigureNotify event when the window first appears:
-   vt->resize (winWidth, winHeight);
+   // Every pane runs the same program
+   const char* execPath = progPath;
+   const char* const* execArgv = shArgv;
+   // We might not get a ConfigureNotify event when the window first appears,
+   // so the Workspace starts out with the initial window size.
+   workspace = std::make_unique <Workspace> (
+      fontpk->getPx (), fontpk->getPy (), winWidth, winHeight, *renderer,
+      [execPath, execArgv] (uint16_t nCols, uint16_t nRows)
+      {
+         return startShell (execPath, execArgv, nCols, nRows);
+      },
+      [] (Vterm& term)
+      {
+         const Vterm* t = &term;
+         term.setOscHandler ([t] (int cmd, const std::string& arg)
+                             { handleOsc (*t, cmd, arg); });
+         term.setBellHandler ([] () { XBell (xDisplay, 0); });
+      },
+      [] (Vterm* focused) { vt = focused; },
+      [] (const std::string& title) { setXWindowName (title); });
 
-   bool destroyed = eventLoop (xic, ptyFd);
+   bool destroyed = eventLoop (xic);
 
+   workspace = nullptr;
    renderer = nullptr; // ~Renderer () shuts down renderer thread
 
-   eglDestroyContext (eglDpy, eglCtx);
-   eglDestroySurface (eglDpy, eglSurface);
-   eglTerminate (eglDpy);
+   if (!software)
+   {
+      eglDestroyContext (eglDpy, eglCtx);
+      eglDestroySurface (eglDpy, eglSurface);
+      eglTerminate (eglDpy);
+   }
 
    if (! destroyed)
       XDestroyWindow (xDisplay, xWindow);
@@ -1474,3 +1681,84 @@ main (int argc, char* argv[])
 
    return 0;
 }
+
+static int
+runServerWindow (zutty::ServerRequest& req)
+{
+   std::vector <char*> argv;
+   char argv0 [] = "zutty";
+   argv.push_back (argv0);
+   for (auto& arg: req.args)
+      argv.push_back (&arg [0]);
+   argv.push_back (nullptr);
+   int argc = argv.size () - 1;
+
+   setlocale (LC_ALL, ""); // as per the client's environment
+   if (openDisplay (&argc, argv.data ()) < 0)
+      return -1;
+
+   if (setenv ("ZUTTY_VERSION", ZUTTY_VERSION, 1) < 0)
+      SYS_ERROR ("setenv (ZUTTY_VERSION)");
+
+   return runWindow (argc, argv.data ());
+}
+
+int
+main (int argc, char* argv[])
+{
+   {
+      const char* loc;
+      bool warn = false;
+      loc = setlocale (LC_ALL, "");
+      if (!loc)
+      {
+         std::cout << "Warning: could not set locale!" << std::endl;
+         warn = true;
+      }
+      else if (strcmp (nl_langinfo (CODESET), "UTF-8") != 0)
+      {
+         std::cout << "Warning: non-UTF-8 locale: " << loc << std::endl;
+         warn = true;
+      }
+      if (warn)
+         std::cout << "Expect broken international characters "
+                   << "(or fix your locale)!"
+                   << std::endl;
+   }
+
+   if (! XInitThreads ())
+   {
+      std::cout << "Error: couldn't initialize XLib for multithreaded use"
+                << std::endl;
+      return -1;
+   }
+
+   XSetErrorHandler(handleXError);
+   XSetIOErrorHandler(handleXIOError);
+
+   if (openDisplay (&argc, argv) < 0)
+      return -1;
+
+   if (opts.verbose)
+      opts.printVersion ();
+
+   if (setenv ("ZUTTY_VERSION", ZUTTY_VERSION, 1) < 0)
+      SYS_ERROR ("setenv (ZUTTY_VERSION)");
+
+   fontpk = std::make_unique <Fontpack> (opts.fontpath, opts.fontname,
+                                         opts.dwfontname);
+
+   if (opts.headless)
+      return zutty::runHeadless (fontpk.get (), opts.headless);
+
+   if (opts.server)
+   {
+      // Window processes forked by the server open their own connection
+      XCloseDisplay (xDisplay);
+      xDisplay = nullptr;
+      opts.setDisplay (nullptr);
+      return zutty::runServer (runServerWindow);
+   }
+
+   return runWindow (argc, argv);
+}
@@ -234,6 +234,8 @@ namespace zutty
       if (display)
          setenv ("DISPLAY", display, 1);
 
+      headless = get ("headless");
+
       name = get ("name", getenv ("RESOURCE_NAME"));
       if (name && (strchr (name, '.') || strchr (name, '*')))
          throw std::runtime_error ("-name: supplied value contains "
@@ -313,6 +315,7 @@ namespace zutty
          getFontsize (fontsize);
          getGeometry (nCols, nRows);
          glinfo = getBool ("glinfo");
+         gpuTimers = getBool ("gpuTimers");
          shell = get ("shell", getenv ("SHELL"));
          if (!shell)
             shell = "bash";
@@ -330,9 +333,14 @@ namespace zutty
          altSendsEscape = getBool ("altSendsEscape");
          autoCopyMode = getBool ("autoCopy");
          boldColors = getBool ("boldColors");
+         compute = getBool ("compute");
          login = getBool ("login");
+         lowLatency = getBool ("lowLatency");
+         showDamage = getBool ("showDamage");
          showWraps = getBool ("showWraps");
+         software = getBool ("software");
          quiet = getBool ("quiet");
+         server = getBool ("server");
          verbose = getBool ("verbose");
          modifyOtherKeys = getInteger ("modifyOtherKeys", 0, 2);
       }
@@ -57,6 +57,7 @@ namespace zutty
       {"bg",          SepArg,   nullptr,   "#000",    "Background color"},
       {"boldColors",  NoArg,    "true",    "true",    "Enable bright for bold"},
       {"border",      SepArg,   nullptr,   "2",       "Border width in pixels"},
+      {"compute",     NoArg,    "true",    "true",    "Render with compute shaders if available"},
       {"cr",          SepArg,   nullptr,   nullptr,   "Cursor color"},
       {"display",     SepArg,   nullptr,   nullptr,   "Display to connect to"},
       {"dwfont",      SepArg,   nullptr,   "18x18ja", "Double-width font to use"},
@@ -66,14 +67,20 @@ namespace zutty
       {"fontpath",    SepArg,   nullptr,   fontpath,  "Font search path"},
       {"geometry",    SepArg,   nullptr,   "80x24",   "Terminal size in chars"},
       {"glinfo",      NoArg,    "true",    "false",   "Print OpenGL information"},
+      {"gpuTimers",   NoArg,    "true",    "false",   "Measure GPU time of rendering (debug)"},
+      {"headless",    SepArg,   nullptr,   nullptr,   "Render input file offscreen and quit"},
       {"help",        NoArg,    "true",    "false",   "Print usage listing and quit"},
       {"listres",     NoArg,    "true",    "false",   "Print resource listing and quit"},
       {"login",       NoArg,    "true",    "false",   "Start shell as a login shell"},
+      {"lowLatency",  NoArg,    "true",    "false",   "Render just in time for vblank"},
       {"name",        SepArg,   nullptr,   nullptr,   "Instance name for Xrdb and WM_CLASS"},
       {"rv",          NoArg,    "true",    "false",   "Reverse video"},
       {"saveLines",   SepArg,   nullptr,   "500",     "Lines of scrollback history"},
+      {"server",      NoArg,    "true",    "false",   "Run as server for zuttyc clients"},
       {"shell",       SepArg,   nullptr,   nullptr,   "Shell program to run"},
+      {"showDamage",  NoArg,    "true",    "false",   "Tint redrawn cells (debug)"},
       {"showWraps",   NoArg,    "true",    "false",   "Show wrap marks at right margin"},
+      {"software",    NoArg,    "true",    "false",   "Render on the CPU, without OpenGL"},
       {"title",       SepArg,   nullptr,   "Zutty",   "Window title"},
       {"quiet",       NoArg,    "true",    "false",   "Silence logging output"},
       {"verbose",     NoArg,    "true",    "false",   "Output info messages"},
@@ -123,6 +130,7 @@ namespace zutty
       const char* dwfontname;
       const char* fontname;
       const char* fontpath;
+      const char* headless;
       const char* name;
       const char* shell;
       const char* title;
@@ -134,11 +142,17 @@ namespace zutty
       bool altSendsEscape;
       bool autoCopyMode;
       bool boldColors;
+      bool compute;
       bool glinfo;
+      bool gpuTimers;
       bool login;
+      bool lowLatency;
+      bool showDamage;
       bool showWraps;
+      bool software;
       bool quiet;
       bool rv;
+      bool server;
       bool verbose;
 
       void initialize (int* argc, char** argv);
@@ -0,0 +1,102 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "pacer.h"
+#include "log.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace zutty
+{
+   constexpr const std::chrono::microseconds FramePacer::defaultPeriod;
+   constexpr const std::chrono::microseconds FramePacer::margin;
+   constexpr const int FramePacer::nRenderTimes;
+
+   FramePacer::FramePacer (const SyncValues& syncValues_)
+      : syncValues (syncValues_)
+   {
+   }
+
+   FramePacer::Clock::time_point
+   FramePacer::renderStart (Clock::time_point now)
+   {
+      updateVblank ();
+      if (lastVblank == Clock::time_point () || lastVblank > now)
+         return now;
+
+      // Leave enough time to render before the next vblank; if it is
+      // too late for that, rendering now still makes the one after.
+      const auto nPeriods = (now - lastVblank) / period + 1;
+      const Clock::time_point nextVblank = lastVblank + nPeriods * period;
+      return std::max (now, nextVblank - budget);
+   }
+
+   void
+   FramePacer::framePresented (Clock::time_point start,
+                               Clock::time_point submit,
+                               Clock::time_point swapped)
+   {
+      if (!updateVblank ())
+         lastVblank = swapped;
+
+      // The time of rendering up to the submit, as a swap waiting for
+      // vblank is not part of it. The budget is the 90th percentile of
+      // the recent frames, so that an occasional slow frame does not
+      // make all of them later.
+      renderTimes [nextRenderTime] = submit - start;
+      nextRenderTime = (nextRenderTime + 1) % nRenderTimes;
+      nRenderTimesKept = std::min (nRenderTimesKept + 1, nRenderTimes);
+
+      std::vector <Clock::duration> t (renderTimes.begin (),
+                                       renderTimes.begin () + nRenderTimesKept);
+      auto nth = t.begin () + (t.size () - 1) * 90 / 100;
+      std::nth_element (t.begin (), nth, t.end ());
+      budget = std::min <Clock::duration> (*nth + margin, period);
+   }
+
+   // private methods
+
+   bool
+   FramePacer::updateVblank ()
+   {
+      using namespace std::chrono;
+      int64_t ust, msc;
+      if (!syncValues || !syncValues (ust, msc))
+         return false;
+
+      // UST is expected to be on the monotonic clock (as with Mesa);
+      // anything else is of no use.
+      const Clock::time_point vblank {microseconds (ust)};
+      const Clock::time_point now = Clock::now ();
+      if (vblank > now || now - vblank > seconds (1))
+      {
+         logT << "FramePacer: UST not on the monotonic clock" << std::endl;
+         syncValues = nullptr;
+         return false;
+      }
+
+      if (lastMsc >= 0 && msc > lastMsc && vblank > lastVblank)
+      {
+         const Clock::duration p = (vblank - lastVblank) / (msc - lastMsc);
+         // Sanity check (between 500 and 10 Hz), then smooth the estimate
+         if (p > milliseconds (2) && p < milliseconds (100))
+            period = (7 * period + p) / 8;
+      }
+      if (msc != lastMsc)
+      {
+         lastVblank = vblank;
+         lastMsc = msc;
+      }
+      return true;
+   }
+
+} // namespace zutty
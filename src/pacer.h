@@ -0,0 +1,73 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace zutty
+{
+   /* Frame pacing of the low latency mode (-lowLatency). A frame drawn
+    * as soon as it arrives waits in eglSwapBuffers for the next vblank,
+    * and output arriving meanwhile (e.g., the echo of a keystroke) waits
+    * for the frame after that. Instead, the Renderer waits to start
+    * rendering until just before the next vblank, less the time that
+    * rendering is expected to take, and picks up the newest frames then.
+    *
+    * The time of the last vblank and the refresh period come from
+    * EGL_CHROMIUM_sync_control if available; otherwise, the return of
+    * the (blocking) buffer swaps marks the vblanks of a 60 Hz display.
+    */
+   class FramePacer
+   {
+   public:
+      using Clock = std::chrono::steady_clock;
+
+      /* Get the time (UST, in microseconds of CLOCK_MONOTONIC) and the
+       * count (MSC) of the last vblank; returns false if not available.
+       */
+      using SyncValues = std::function <bool (int64_t& ust, int64_t& msc)>;
+
+      explicit FramePacer (const SyncValues& syncValues = nullptr);
+
+      // When to start rendering a frame that is ready at now
+      Clock::time_point renderStart (Clock::time_point now);
+
+      /* Account for a frame that started rendering at start, was
+       * submitted (swapBuffers called) at submit, and was swapped
+       * (swapBuffers returned) at swapped.
+       */
+      void framePresented (Clock::time_point start, Clock::time_point submit,
+                           Clock::time_point swapped);
+
+   private:
+      static constexpr const std::chrono::microseconds defaultPeriod {16667};
+      // Slack for wakeup latency and GPU work not seen by the CPU
+      static constexpr const std::chrono::microseconds margin {1500};
+      static constexpr const int nRenderTimes = 64;
+
+      SyncValues syncValues;
+      Clock::time_point lastVblank;
+      int64_t lastMsc = -1;
+      Clock::duration period = defaultPeriod;
+      Clock::duration budget = margin; // rendering takes up to this long
+
+      std::array <Clock::duration, nRenderTimes> renderTimes;
+      int nRenderTimesKept = 0;
+      int nextRenderTime = 0;
+
+      bool updateVblank ();
+   };
+
+} // namespace zutty
@@ -0,0 +1,38 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+/* Static tracepoints (USDT probes) of provider "zutty", for attaching
+ * bpftrace, perf or SystemTap to a running (release) build. A probe that
+ * is not attached costs a single nop instruction. Without sys/sdt.h at
+ * configuration time, the probes are compiled out altogether.
+ *
+ * See "Static tracepoints" in doc/HACKING.org for the list of probes.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define PROBE(name)              DTRACE_PROBE (zutty, name)
+#define PROBE1(name, a)          DTRACE_PROBE1 (zutty, name, a)
+#define PROBE2(name, a, b)       DTRACE_PROBE2 (zutty, name, a, b)
+#define PROBE3(name, a, b, c)    DTRACE_PROBE3 (zutty, name, a, b, c)
+
+#else
+
+#define PROBE(name)              do {} while (0)
+#define PROBE1(name, a)          do {} while (0)
+#define PROBE2(name, a, b)       do {} while (0)
+#define PROBE3(name, a, b, c)    do {} while (0)
+
+#endif // HAVE_SYS_SDT_H
@@ -148,6 +148,14 @@ namespace zutty
       return pid;
    }
 
+   void
+   pty_open (int& o_masterFd, int& o_slaveFd)
+   {
+      char pts_name [20];
+      o_masterFd = ptym_open (pts_name, sizeof (pts_name));
+      o_slaveFd = ptys_open (pts_name);
+   }
+
    void pty_resize (int ptyFd, int cols, int rows)
    {
       struct winsize wsize {};
@@ -18,6 +18,9 @@ namespace zutty
 {
    pid_t pty_fork (int& o_ptyFd, int cols, int rows);
 
+   // Open a master/slave pair without a child process (for headless mode)
+   void pty_open (int& o_masterFd, int& o_slaveFd);
+
    void pty_resize (int ptyFd, int cols, int rows);
 
 } // namespace zutty
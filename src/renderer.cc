@@ -9,17 +9,98 @@
  * See the file LICENSE for the full license.
  */
 
+#include "hud.h"
+#include "probe.h"
 #include "renderer.h"
 
+#include <algorithm>
 #include <cassert>
 
+namespace
+{
+   using namespace zutty;
+
+   Rect
+   offsetRect (const Rect& r, const Point& origin)
+   {
+      if (r.null ())
+         return r;
+      Rect ret (r.tl.x + origin.x, r.tl.y + origin.y,
+                r.br.x + origin.x, r.br.y + origin.y);
+      ret.rectangular = r.rectangular;
+      return ret;
+   }
+
+   // Fill for the cells between panes
+   CharVdev::Cell
+   separatorCell ()
+   {
+      CharVdev::Cell cell;
+      cell.bg = Color {uint8_t ((3 * opts.bg.red + opts.fg.red) / 4),
+                       uint8_t ((3 * opts.bg.green + opts.fg.green) / 4),
+                       uint8_t ((3 * opts.bg.blue + opts.fg.blue) / 4)};
+      return cell;
+   }
+
+   /* Clip an image placement (in view coordinates of its frame) to the
+    * pane showing the frame, and move it to the pane's position.
+    * Returns false if nothing remains visible.
+    */
+   bool
+   clipImage (ImagePlacement& p, const Rect& pane, int px, int py)
+   {
+      const int paneCols = pane.br.x - pane.tl.x;
+      const int paneRows = pane.br.y - pane.tl.y;
+      if (p.col >= paneCols || p.row >= paneRows || p.row + p.rows <= 0)
+         return false;
+
+      if (p.row < 0)
+      {
+         const int hidden = -p.row * py;
+         if (hidden >= p.height)
+            return false;
+         p.src.tl.y += (p.src.br.y - p.src.tl.y) * hidden / p.height;
+         p.height -= hidden;
+         p.rows += p.row;
+         p.row = 0;
+      }
+
+      const int maxWidth = (paneCols - p.col) * px;
+      if (p.width > maxWidth)
+      {
+         p.src.br.x = p.src.tl.x +
+                      (p.src.br.x - p.src.tl.x) * maxWidth / p.width;
+         p.width = maxWidth;
+      }
+      const int maxHeight = (paneRows - p.row) * py;
+      if (p.height > maxHeight)
+      {
+         p.src.br.y = p.src.tl.y +
+                      (p.src.br.y - p.src.tl.y) * maxHeight / p.height;
+         p.height = maxHeight;
+      }
+      p.cols = std::min <int> (p.cols, paneCols - p.col);
+      p.rows = std::min <int> (p.rows, paneRows - p.row);
+
+      p.col += pane.tl.x;
+      p.row += pane.tl.y;
+      return true;
+   }
+
+} // namespace
+
 namespace zutty
 {
    Renderer::Renderer (const std::function <void ()>& initDisplay,
-                       const std::function <void ()>& swapBuffers_,
-                       Fontpack* fontpk)
+                       const std::function <void (const Rect&)>& swapBuffers_,
+                       Fontpack* fontpk, Window softWindow,
+                       std::unique_ptr <FramePacer> pacer_)
       : swapBuffers {swapBuffers_}
-      , thr (&Renderer::renderThread, this, initDisplay, fontpk)
+      , glyphPx {fontpk->getPx ()}
+      , glyphPy {fontpk->getPy ()}
+      , pacer {std::move (pacer_)}
+      , nextFrames (1)
+      , thr (&Renderer::renderThread, this, initDisplay, fontpk, softWindow)
    {
    }
 
@@ -27,80 +108,291 @@ namespace zutty
    {
       std::unique_lock <std::mutex> lk (mx);
       done = true;
-      nextFrame.seqNo = ++seqNo;
+      ++seqNo;
       lk.unlock ();
       cond.notify_one ();
       thr.join ();
    }
 
    void
-   Renderer::update (const Frame& frame)
+   Renderer::setLayout (uint16_t winPx, uint16_t winPy,
+                        const std::vector <Rect>& panes, int focused)
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      nextLayout.winPx = winPx;
+      nextLayout.winPy = winPy;
+      nextLayout.panes = panes;
+      nextLayout.focused = focused;
+      nextLayout.seqNo = ++seqNo;
+      // Pane indices may refer to other frames now: wait for new ones
+      nextFrames.assign (std::max <size_t> (1, panes.size ()), Frame ());
+      lk.unlock ();
+      cond.notify_one ();
+   }
+
+   void
+   Renderer::update (const Frame& frame, int pane)
    {
+      PROBE1 (renderer_update, pane);
       std::unique_lock <std::mutex> lk (mx);
+      if (pane < 0 || pane >= (int)nextFrames.size ())
+         return;
+
+      // If the render thread has not taken the previous frame yet,
+      // carry its damage over so that the next draw can stay incremental
+      Frame& nextFrame = nextFrames [pane];
+      Frame older = nextFrame;
       nextFrame = frame;
+      nextFrame.mergeDamage (older);
       nextFrame.seqNo = ++seqNo;
       lk.unlock ();
       cond.notify_one ();
    }
 
+   void
+   Renderer::sync ()
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      drawnCond.wait (lk, [this] () { return drawnSeqNo == seqNo; });
+   }
+
+   void
+   Renderer::toggleHud ()
+   {
+      std::unique_lock <std::mutex> lk (mx);
+      hudShown = !hudShown;
+      ++seqNo; // redraw, with or without it
+      lk.unlock ();
+      cond.notify_one ();
+   }
+
    void
    Renderer::renderThread (const std::function <void ()>& initDisplay,
-                           Fontpack* fontpk)
+                           Fontpack* fontpk, Window softWindow)
    {
       initDisplay ();
 
-      charVdev = std::make_unique <CharVdev> (fontpk);
+      if (softWindow != None)
+      {
+         SoftVdev softVdev (fontpk, softWindow);
+         renderLoop (softVdev);
+      }
+      else
+      {
+         CharVdev charVdev (fontpk);
+         renderLoop (charVdev);
+      }
+   }
 
-      Frame lastFrame;
+   template <typename Vdev> void
+   Renderer::renderLoop (Vdev& vdev)
+   {
+      Layout layout;
+      std::vector <Frame> lastFrames (1);
+      std::vector <bool> paneCopied (1, false); // frame fits, cells copied
+      uint64_t takenSeqNo = 0;
       bool delta = false;
+      bool cellsPending = false; // cells copied, but not drawn yet
+      CharVdev::Cursor drawnCursor;
+      Rect drawnSelection;
+      std::vector <ImagePlacement> drawnImages;
+      std::unique_ptr <Hud> hud;
 
       while (1)
       {
          std::unique_lock <std::mutex> lk (mx);
-         cond.wait (lk,
-                    [&] ()
-                    {
-                       return lastFrame.seqNo != nextFrame.seqNo;
-                    });
+         auto ready = [&] () { return takenSeqNo != seqNo; };
+         // Keep the figures of the HUD up to date even without updates
+         if (hud)
+            cond.wait_for (lk, Hud::refreshInterval, ready);
+         else
+            cond.wait (lk, ready);
 
          if (done)
             return;
 
-         if (lastFrame.seqNo + 1 != nextFrame.seqNo)
-            delta = false;
+         // In the low latency mode, let frames keep coming until it is
+         // just in time to render for the next vblank
+         if (pacer && ready ())
+         {
+            const auto start = pacer->renderStart (FramePacer::Clock::now ());
+            if (cond.wait_until (lk, start, [this] () { return done; }))
+               return;
+         }
+         const FramePacer::Clock::time_point takenAt =
+            FramePacer::Clock::now ();
 
-         lastFrame = nextFrame;
+         if (hudShown != (hud != nullptr))
+         {
+            if (hudShown)
+               hud = std::make_unique <Hud> ();
+            else
+               hud.reset ();
+            delta = false; // also to restore the cells under it
+         }
+         takenSeqNo = seqNo;
+         if (layout.seqNo != nextLayout.seqNo)
+         {
+            layout = nextLayout;
+            lastFrames.assign (nextFrames.size (), Frame ());
+            paneCopied.assign (nextFrames.size (), false);
+            delta = false;
+         }
+         for (size_t k = 0; k < nextFrames.size (); ++k)
+            if (nextFrames [k].seqNo != lastFrames [k].seqNo)
+            {
+               lastFrames [k] = nextFrames [k];
+               nextFrames [k].resetDamage (); // taken: nothing to merge
+            }
          lk.unlock ();
 
-         if (charVdev->resize (lastFrame.winPx, lastFrame.winPy))
+         // Without a layout, the window follows the size of the frame
+         const bool single = layout.panes.empty ();
+         if (single && !lastFrames [0])
+            continue; // just switched back, no frame yet
+         auto paneRect = [&] (size_t k)
+         {
+            if (single)
+               return Rect (0, 0, lastFrames [0].nCols, lastFrames [0].nRows);
+            return layout.panes [k];
+         };
+         auto paneFits = [&] (size_t k)
+         {
+            const Rect r = paneRect (k);
+            return lastFrames [k].nCols == r.br.x - r.tl.x &&
+                   lastFrames [k].nRows == r.br.y - r.tl.y;
+         };
+
+         if (vdev.resize (single ? lastFrames [0].winPx : layout.winPx,
+                          single ? lastFrames [0].winPy : layout.winPy))
             delta = false;
 
+         // A pane showing up (its frame now matches the layout) or going
+         // stale needs everything redrawn, as does a new layout.
+         bool copy = !delta;
+         for (size_t k = 0; k < lastFrames.size (); ++k)
          {
-            CharVdev::Mapping m = charVdev->getMapping ();
-            assert (m.nCols == lastFrame.nCols);
-            assert (m.nRows == lastFrame.nRows);
+            if (paneFits (k) != paneCopied [k])
+               delta = false;
+            if (!delta || lastFrames [k].hasDamage ())
+               copy = true;
+         }
 
-            if (delta)
-               lastFrame.deltaCopyCells (m.cells);
-            else
-               lastFrame.fullCopyCells (m.cells);
+         // Frames with only the cursor or the selection changed (e.g.,
+         // focus changes and selection steps) need no copying of cells.
+         if (copy)
+         {
+            auto m = vdev.getMapping ();
+            assert (!single || m.nCols == lastFrames [0].nCols);
+            assert (!single || m.nRows == lastFrames [0].nRows);
+
+            if (!delta && !single)
+               std::fill_n (m.cells, m.nCols * m.nRows, separatorCell ());
+
+            for (size_t k = 0; k < lastFrames.size (); ++k)
+            {
+               paneCopied [k] = paneFits (k);
+               if (!paneCopied [k])
+                  continue;
+
+               const Rect r = paneRect (k);
+               assert (r.br.x <= m.nCols && r.br.y <= m.nRows);
+               CharVdev::Cell* const dst = m.cells + m.nCols * r.tl.y + r.tl.x;
+               if (delta)
+                  vdev.addDamage (offsetRect (
+                     lastFrames [k].deltaCopyCells (dst, m.nCols), r.tl));
+               else
+                  lastFrames [k].fullCopyCells (dst, m.nCols);
+               lastFrames [k].resetDamage (); // copied
+            }
+            cellsPending = true;
          }
 
-         charVdev->setDeltaFrame (delta);
-         charVdev->setCursor (lastFrame.getCursor ());
-         charVdev->setSelection (lastFrame.getSnappedSelection ());
+         // The HUD is drawn over the cells, so after they are copied
+         if (hud)
+         {
+            if (hud->update ())
+               hud->setGpuTimes (vdev.getGpuTimes ());
+            if (copy || hud->changed ())
+            {
+               auto m = vdev.getMapping ();
+               vdev.addDamage (hud->draw (m.cells, m.nCols, m.nRows));
+               cellsPending = true;
+            }
+         }
 
-         if (lastFrame.seqNo == nextFrame.seqNo)
+         // Skip drawing an outdated frame. Its cells have been copied
+         // (and marked dirty), and the vdev keeps their damage as well as
+         // the last drawn cursor and selection, so the next draw can still
+         // be incremental.
+         if (takenSeqNo != seqNo)
+            continue;
+
+         // The cursor and the selection are those of the focused pane
+         CharVdev::Cursor cursor;
+         Rect selection;
+         Rect selectArea;
+         const size_t focused = single ? 0 : layout.focused;
+         if (focused < lastFrames.size () && paneCopied [focused])
          {
-            charVdev->draw ();
-            swapBuffers ();
-            delta = true;
+            const Frame& frame = lastFrames [focused];
+            const Rect r = paneRect (focused);
+            cursor = frame.getCursor ();
+            cursor.posX += r.tl.x;
+            cursor.posY += r.tl.y;
+            selection = offsetRect (frame.getSnappedSelection (), r.tl);
+            if (!single)
+               selectArea = r;
          }
-         else
+
+         std::vector <ImagePlacement> images;
+         for (size_t k = 0; k < lastFrames.size (); ++k)
          {
-            // skip drawing outdated frame; force full redraw next time
-            delta = false;
+            if (!paneCopied [k])
+               continue;
+            if (single)
+            {
+               images = lastFrames [k].getVisibleImages ();
+               break;
+            }
+            for (auto& p: lastFrames [k].getVisibleImages ())
+               if (clipImage (p, paneRect (k), glyphPx, glyphPy))
+                  images.push_back (p);
+         }
+
+         // If nothing has changed at all, there is nothing to draw.
+         if (cellsPending || cursor != drawnCursor ||
+             selection != drawnSelection || images != drawnImages)
+         {
+            PROBE1 (render_begin, (int)delta);
+            const Hud::Clock::time_point renderStart =
+               hud ? Hud::Clock::now () : Hud::Clock::time_point ();
+            vdev.setDeltaFrame (delta);
+            vdev.setCursor (cursor);
+            vdev.setSelection (selection, selectArea);
+            vdev.setImages (images);
+
+            const Rect damage = vdev.draw ();
+            const FramePacer::Clock::time_point submitted =
+               FramePacer::Clock::now ();
+            swapBuffers (damage);
+            PROBE1 (render_end, (int)delta);
+            if (pacer)
+               pacer->framePresented (takenAt, submitted,
+                                      FramePacer::Clock::now ());
+            if (hud)
+               hud->frameDrawn (delta, Hud::Clock::now () - renderStart);
+            delta = true;
+            cellsPending = false;
+            drawnCursor = cursor;
+            drawnSelection = selection;
+            drawnImages = images;
          }
+
+         lk.lock ();
+         drawnSeqNo = takenSeqNo;
+         lk.unlock ();
+         drawnCond.notify_all ();
       }
    }
 
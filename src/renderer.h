@@ -13,6 +13,8 @@
 
 #include "charvdev.h"
 #include "frame.h"
+#include "pacer.h"
+#include "softvdev.h"
 
 #include <condition_variable>
 #include <cstdint>
@@ -20,33 +22,76 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace zutty
 {
    class Renderer
    {
    public:
+      /* swapBuffers is passed the damaged area of the window as returned
+       * by CharVdev::draw (); a null Rect means the whole window.
+       * If softWindow is given, render into that window on the CPU
+       * via SoftVdev instead; initDisplay and swapBuffers are still
+       * called, but they have nothing to do in that case.
+       * With a pacer, frames are rendered as late as possible before the
+       * next vblank (see pacer.h), else as soon as they arrive.
+       */
       Renderer (const std::function <void ()>& initDisplay,
-                const std::function <void ()>& swapBuffers,
-                Fontpack* fontpk);
+                const std::function <void (const Rect&)>& swapBuffers,
+                Fontpack* fontpk, Window softWindow = None,
+                std::unique_ptr <FramePacer> pacer = nullptr);
 
       ~Renderer ();
 
-      void update (const Frame& frame);
+      /* Split the window (winPx x winPy pixels) into panes: rectangles
+       * of the character grid (bottom right exclusive), each showing the
+       * frame last passed to update () with the index of the pane. Cells
+       * outside all panes are drawn as separators. Only the focused pane
+       * shows its cursor and selection. Without a layout (or with an
+       * empty one), the frame of pane 0 fills the window.
+       */
+      void setLayout (uint16_t winPx, uint16_t winPy,
+                      const std::vector <Rect>& panes, int focused);
+
+      void update (const Frame& frame, int pane = 0);
+
+      // Wait until the last frame passed to update () has been presented
+      void sync ();
+
+      // Show or hide the performance HUD (see hud.h)
+      void toggleHud ();
 
    private:
-      std::unique_ptr <CharVdev> charVdev;
-      const std::function <void ()> swapBuffers;
-      Frame nextFrame;
-      uint64_t seqNo = 0;
+      struct Layout
+      {
+         uint16_t winPx = 0;
+         uint16_t winPy = 0;
+         std::vector <Rect> panes;
+         int focused = 0;
+         uint64_t seqNo = 0;
+      };
+
+      const std::function <void (const Rect&)> swapBuffers;
+      const uint16_t glyphPx;
+      const uint16_t glyphPy;
+      std::unique_ptr <FramePacer> pacer; // used by the render thread
+      Layout nextLayout;
+      std::vector <Frame> nextFrames; // by pane
+      uint64_t seqNo = 0; // of the last update or layout change
+      uint64_t drawnSeqNo = 0;
+      bool hudShown = false;
       bool done = false;
 
       std::condition_variable cond;
+      std::condition_variable drawnCond;
       std::mutex mx;
       std::thread thr;
 
       void renderThread (const std::function <void ()>& initDisplay,
-                         Fontpack* fontpk);
+                         Fontpack* fontpk, Window softWindow);
+
+      template <typename Vdev> void renderLoop (Vdev& vdev);
    };
 
 } // namespace zutty
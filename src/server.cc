@@ -0,0 +1,192 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "log.h"
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+extern char** environ;
+
+namespace
+{
+   using zutty::ServerRequest;
+
+   // Upper limit on request size, to guard against runaway clients
+   constexpr const size_t maxRequestSize = 1024 * 1024;
+
+   bool
+   readRequest (int fd, ServerRequest& req)
+   {
+      struct timeval tv {};
+      tv.tv_sec = 5;
+      setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv));
+
+      std::string msg;
+      char buf [4096];
+      while (msg.size () < maxRequestSize)
+      {
+         ssize_t n = read (fd, buf, sizeof (buf));
+         if (n < 0 && errno == EINTR)
+            continue;
+         if (n < 0)
+         {
+            SYS_WARN ("read from client");
+            return false;
+         }
+         if (n == 0)
+            return req.decode (msg);
+         msg.append (buf, n);
+      }
+      return false;
+   }
+
+   void
+   reply (int fd, const std::string& msg)
+   {
+      if (write (fd, msg.data (), msg.size ()) < 0)
+         SYS_WARN ("write to client");
+   }
+
+   // Executed in the forked child: set up the process to run the request
+   void
+   setupChild (ServerRequest& req)
+   {
+      // Dispositions set to SIG_IGN would be inherited by the shell
+      signal (SIGCHLD, SIG_DFL);
+      signal (SIGPIPE, SIG_DFL);
+
+      // N.B.: leaked on purpose; environ must stay valid for the process
+      char** envp = new char* [req.env.size () + 1];
+      for (size_t k = 0; k < req.env.size (); ++k)
+         envp [k] = strdup (req.env [k].c_str ());
+      envp [req.env.size ()] = nullptr;
+      environ = envp;
+
+      if (chdir (req.cwd.c_str ()) < 0)
+         SYS_WARN ("chdir to ", req.cwd);
+   }
+
+} // namespace
+
+namespace zutty
+{
+   int
+   runServer (const std::function <int (ServerRequest&)>& runWindow)
+   {
+      std::string fallbackDir;
+      const std::string path = getServerSocketPath (&fallbackDir);
+      if (!fallbackDir.empty ())
+      {
+         const std::string err = checkSocketDir (fallbackDir);
+         if (!err.empty ())
+         {
+            logE << "Server socket directory: " << err << std::endl;
+            return -1;
+         }
+      }
+
+      struct sockaddr_un addr {};
+      addr.sun_family = AF_UNIX;
+      if (path.size () >= sizeof (addr.sun_path))
+      {
+         logE << "Server socket path too long: " << path << std::endl;
+         return -1;
+      }
+      strncpy (addr.sun_path, path.c_str (), sizeof (addr.sun_path) - 1);
+
+      int listenFd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (listenFd < 0)
+         SYS_ERROR ("socket");
+      fcntl (listenFd, F_SETFD, FD_CLOEXEC);
+
+      // Refuse to take over the socket of a running server, but remove
+      // the stale socket file left behind by one that is gone.
+      if (connect (listenFd, (struct sockaddr*) &addr, sizeof (addr)) == 0)
+      {
+         logE << "Another server is already listening on " << path
+              << std::endl;
+         return -1;
+      }
+      unlink (path.c_str ());
+
+      mode_t umaskPrev = umask (0077);
+      int rc = bind (listenFd, (struct sockaddr*) &addr, sizeof (addr));
+      umask (umaskPrev);
+      if (rc < 0)
+         SYS_ERROR ("bind to ", path);
+      if (listen (listenFd, 16) < 0)
+         SYS_ERROR ("listen on ", path);
+
+      signal (SIGCHLD, SIG_IGN); // children are reaped automatically
+      signal (SIGPIPE, SIG_IGN); // clients might go away before our reply
+
+      logI << "Server listening on " << path << std::endl;
+
+      while (true)
+      {
+         int fd = accept (listenFd, nullptr, nullptr);
+         if (fd < 0)
+         {
+            if (errno == EINTR || errno == ECONNABORTED)
+               continue;
+            SYS_ERROR ("accept");
+         }
+         fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+         if (!isPeerSameUser (fd))
+         {
+            logW << "Ignoring request from a client of another user"
+                 << std::endl;
+            close (fd);
+            continue;
+         }
+
+         ServerRequest req;
+         if (!readRequest (fd, req))
+         {
+            logW << "Ignoring malformed client request" << std::endl;
+            reply (fd, "Error: malformed request\n");
+            close (fd);
+            continue;
+         }
+
+         pid_t pid = fork ();
+         if (pid < 0)
+         {
+            SYS_WARN ("fork");
+            reply (fd, std::string ("Error: fork: ") + strerror (errno) +
+                   "\n");
+         }
+         else if (pid == 0)
+         {
+            close (fd);
+            close (listenFd);
+            setupChild (req);
+            exit (runWindow (req));
+         }
+         else
+         {
+            logI << "Started window process " << pid << std::endl;
+            reply (fd, std::to_string (pid) + "\n");
+         }
+         close (fd);
+      }
+   }
+
+} // namespace zutty
@@ -0,0 +1,170 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(SOLARIS)
+#include <ucred.h>
+#endif
+
+/* Server mode: a zutty process started with -server loads the fonts and
+ * rasterizes the glyph atlases once, then listens on a UNIX domain socket.
+ * For each request sent by the zuttyc client it forks a child that opens
+ * a new window, sharing the font data with the server copy-on-write.
+ * Everything else, the X connection, GL context, shaders and textures
+ * included, is set up by each child on its own.
+ *
+ * This header is shared with zuttyc, so it must not depend on X or GL.
+ */
+namespace zutty
+{
+   /* $ZUTTY_SOCKET, or zutty.sock in $XDG_RUNTIME_DIR, or server.sock in
+    * /tmp/zutty-UID. In the latter case, that directory is returned in
+    * fallbackDir, as it is up to us to keep it private (see checkSocketDir).
+    */
+   inline std::string
+   getServerSocketPath (std::string* fallbackDir = nullptr)
+   {
+      const char* path = getenv ("ZUTTY_SOCKET");
+      if (path && path [0])
+         return path;
+
+      const char* dir = getenv ("XDG_RUNTIME_DIR");
+      if (dir && dir [0])
+         return std::string (dir) + "/zutty.sock";
+
+      const std::string fbDir = "/tmp/zutty-" + std::to_string (getuid ());
+      if (fallbackDir)
+         *fallbackDir = fbDir;
+      return fbDir + "/server.sock";
+   }
+
+   /* Check that dir (created if missing) is a real directory, owned by us
+    * and not accessible by anyone else, so that nobody else can create,
+    * remove or replace the socket in it. Returns an error message, or an
+    * empty string on success.
+    */
+   inline std::string
+   checkSocketDir (const std::string& dir)
+   {
+      if (mkdir (dir.c_str (), 0700) < 0 && errno != EEXIST)
+         return "can't create " + dir + ": " + strerror (errno);
+
+      struct stat st;
+      if (lstat (dir.c_str (), &st) < 0)
+         return "can't stat " + dir + ": " + strerror (errno);
+      if (!S_ISDIR (st.st_mode))
+         return dir + " is not a directory";
+      if (st.st_uid != getuid ())
+         return dir + " is owned by another user";
+      if (st.st_mode & 077)
+         return dir + " is accessible by other users";
+      return "";
+   }
+
+   // Whether the process at the other end of a connected UNIX domain
+   // socket runs as our user
+   inline bool
+   isPeerSameUser (int fd)
+   {
+   #if defined(LINUX)
+      struct ucred cred;
+      socklen_t len = sizeof (cred);
+      if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+         return false;
+      return cred.uid == getuid ();
+   #elif defined(SOLARIS)
+      ucred_t* cred = nullptr;
+      if (getpeerucred (fd, &cred) < 0)
+         return false;
+      const bool same = ucred_geteuid (cred) == getuid ();
+      ucred_free (cred);
+      return same;
+   #else
+      uid_t euid;
+      gid_t egid;
+      if (getpeereid (fd, &euid, &egid) < 0)
+         return false;
+      return euid == getuid ();
+   #endif
+   }
+
+   /* A request to open a new window. On the wire, this is a sequence of
+    * NUL-terminated strings: the working directory, the number of
+    * arguments, the arguments, then the environment up to end of stream.
+    * The server replies with the process id of the new window, or with
+    * an error message starting with "Error:".
+    */
+   struct ServerRequest
+   {
+      std::string cwd;
+      std::vector <std::string> args; // command line, excluding argv [0]
+      std::vector <std::string> env;
+
+      std::string
+      encode () const
+      {
+         std::string msg;
+         auto put = [&] (const std::string& s) { msg += s; msg += '\0'; };
+         put (cwd);
+         put (std::to_string (args.size ()));
+         for (const auto& arg: args)
+            put (arg);
+         for (const auto& var: env)
+            put (var);
+         return msg;
+      }
+
+      bool
+      decode (const std::string& msg)
+      {
+         std::vector <std::string> items;
+         size_t pos = 0;
+         while (pos < msg.size ())
+         {
+            size_t end = msg.find ('\0', pos);
+            if (end == std::string::npos)
+               return false;
+            items.push_back (msg.substr (pos, end - pos));
+            pos = end + 1;
+         }
+         if (items.size () < 2)
+            return false;
+
+         char* endp;
+         size_t nArgs = strtoul (items [1].c_str (), &endp, 10);
+         if (*endp || items.size () < 2 + nArgs)
+            return false;
+
+         cwd = items [0];
+         args.assign (items.begin () + 2, items.begin () + 2 + nArgs);
+         env.assign (items.begin () + 2 + nArgs, items.end ());
+         return true;
+      }
+   };
+
+   /* Listen for requests and run runWindow in a forked child for each.
+    * The child's working directory and environment are set up from the
+    * request before the call. Only returns on error.
+    */
+   int runServer (const std::function <int (ServerRequest&)>& runWindow);
+
+} // namespace zutty
@@ -0,0 +1,292 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "sixel.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+   using namespace zutty;
+
+   constexpr const uint32_t maxParam = 1000000;
+
+   // VT340 default color registers, in percent
+   const uint8_t defaultPalette [16][3] =
+   {
+      { 0,  0,  0}, {20, 20, 80}, {80, 13, 13}, {20, 80, 20},
+      {80, 20, 80}, {20, 80, 80}, {80, 80, 20}, {53, 53, 53},
+      {26, 26, 26}, {33, 33, 60}, {60, 26, 26}, {33, 60, 33},
+      {60, 33, 60}, {33, 60, 60}, {60, 60, 33}, {80, 80, 80}
+   };
+
+   uint32_t
+   rgba (uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255)
+   {
+      const uint8_t bytes [4] = {r, g, b, a};
+      uint32_t px;
+      memcpy (&px, bytes, sizeof (px));
+      return px;
+   }
+
+   uint8_t
+   percent (uint32_t p)
+   {
+      return (std::min (p, 100u) * 255 + 50) / 100;
+   }
+
+   // DEC HLS: hue 0..360 (0 is blue), lightness and saturation 0..100
+   uint32_t
+   hls (uint32_t h, uint32_t l, uint32_t s)
+   {
+      const float lf = std::min (l, 100u) / 100.0f;
+      const float sf = std::min (s, 100u) / 100.0f;
+      const float q = lf < 0.5f ? lf * (1.0f + sf) : lf + sf - lf * sf;
+      const float p = 2.0f * lf - q;
+      const float hf = ((h + 240) % 360) / 360.0f;
+
+      auto channel = [=] (float t)
+      {
+         if (t < 0.0f) t += 1.0f;
+         if (t > 1.0f) t -= 1.0f;
+         float v;
+         if (t < 1.0f / 6.0f)
+            v = p + (q - p) * 6.0f * t;
+         else if (t < 0.5f)
+            v = q;
+         else if (t < 2.0f / 3.0f)
+            v = p + (q - p) * (2.0f / 3.0f - t) * 6.0f;
+         else
+            v = p;
+         return uint8_t (v * 255.0f + 0.5f);
+      };
+      return rgba (channel (hf + 1.0f / 3.0f), channel (hf),
+                   channel (hf - 1.0f / 3.0f));
+   }
+
+} // namespace
+
+namespace zutty
+{
+   void
+   SixelDecoder::begin (bool transparent, const Color& bg)
+   {
+      state = State::Data;
+      nParams = 0;
+      repeat = 1;
+
+      for (int k = 0; k < 256; ++k)
+      {
+         const uint8_t* c = defaultPalette [k % 16];
+         palette [k] = rgba (percent (c [0]), percent (c [1]),
+                             percent (c [2]));
+      }
+      color = palette [0];
+      fill = transparent ? 0 : rgba (bg.red, bg.green, bg.blue);
+
+      posX = posY = 0;
+      width = height = 0;
+      rasterWidth = rasterHeight = 0;
+      capWidth = capHeight = 0;
+      pixels.clear ();
+   }
+
+   /* The hot path is the Data state: each sixel character expands to a
+    * band of up to six rows of (repeat count) pixels, written as runs of
+    * the current color.
+    */
+   void
+   SixelDecoder::feed (const unsigned char* data, size_t len)
+   {
+      for (size_t k = 0; k < len; ++k)
+      {
+         const unsigned char c = data [k];
+         if (state != State::Data)
+         {
+            if (c >= '0' && c <= '9')
+            {
+               uint32_t& p = params [nParams - 1];
+               if (p < maxParam)
+                  p = 10 * p + (c - '0');
+               continue;
+            }
+            if (c == ';' && state != State::Repeat)
+            {
+               if (nParams < maxParams)
+                  params [nParams++] = 0;
+               continue;
+            }
+            endCommand ();
+         }
+
+         if (c >= '?' && c <= '~')
+         {
+            putSixel (c - '?', repeat);
+            repeat = 1;
+            continue;
+         }
+
+         switch (c)
+         {
+         case '!': state = State::Repeat; break;
+         case '#': state = State::Color; break;
+         case '"': state = State::Raster; break;
+         case '$': posX = 0; break; // Graphics Carriage Return
+         case '-': posX = 0; posY += 6; break; // Graphics New Line
+         default: continue; // ignore anything else
+         }
+         if (state != State::Data)
+         {
+            params [0] = 0;
+            nParams = 1;
+         }
+      }
+   }
+
+   ImagePtr
+   SixelDecoder::finish ()
+   {
+      if (state != State::Data)
+         endCommand ();
+
+      // The declared raster size only extends an image that has content;
+      // pixels beyond what was drawn are never allocated before this.
+      ImagePtr result;
+      if (width > 0 && height > 0)
+      {
+         const int w = std::max (width, rasterWidth);
+         const int h = std::max (height, rasterHeight);
+         auto image = std::make_shared <Image> ();
+         image->width = w;
+         image->height = h;
+         image->rgba.resize (4 * w * h);
+         const std::vector <uint32_t> fillRow (w, fill);
+         for (int y = 0; y < h; ++y)
+         {
+            uint8_t* const dst = image->rgba.data () + 4 * y * w;
+            const int x = y < height ? width : 0;
+            if (x)
+               memcpy (dst, pixels.data () + y * capWidth, 4 * x);
+            memcpy (dst + 4 * x, fillRow.data (), 4 * (w - x));
+         }
+         result = image;
+      }
+
+      pixels.clear ();
+      pixels.shrink_to_fit ();
+      capWidth = capHeight = 0;
+      return result;
+   }
+
+   // private methods
+
+   void
+   SixelDecoder::endCommand ()
+   {
+      switch (state)
+      {
+      case State::Repeat:
+         repeat = std::max (1u, std::min (params [0], (uint32_t)maxImageSize));
+         break;
+      case State::Color:
+         if (params [0] > 255)
+            break;
+         if (nParams >= 5)
+         {
+            if (params [1] == 1)
+               palette [params [0]] = hls (params [2], params [3], params [4]);
+            else if (params [1] == 2)
+               palette [params [0]] = rgba (percent (params [2]),
+                                            percent (params [3]),
+                                            percent (params [4]));
+         }
+         color = palette [params [0]];
+         break;
+      case State::Raster: // Pan; Pad; Ph; Pv -- only the size is used
+         // Only a hint: nothing is allocated until sixels are drawn.
+         if (nParams >= 4)
+         {
+            rasterWidth = std::max (rasterWidth, (int)std::min (
+                                       params [2], (uint32_t)maxImageSize));
+            rasterHeight = std::max (rasterHeight, (int)std::min (
+                                        params [3], (uint32_t)maxImageSize));
+         }
+         break;
+      case State::Data:
+         break;
+      }
+      state = State::Data;
+   }
+
+   void
+   SixelDecoder::putSixel (uint32_t bits, uint32_t count)
+   {
+      const int n = std::min ((int)count, maxImageSize - posX);
+      if (n <= 0 || posY + 6 > maxImageSize)
+         return;
+      if (bits == 0)
+      {
+         posX += n;
+         return;
+      }
+      if ((posX + n > capWidth || posY + 6 > capHeight) &&
+          !reserve (posX + n, posY + 6))
+         return;
+
+      // Visit the set bits only; single pixels (the common case for
+      // photographic content) are stored directly.
+      uint32_t* const dst = pixels.data () + posY * capWidth + posX;
+      const int topBit = 31 - __builtin_clz (bits);
+      if (n == 1)
+      {
+         for (uint32_t b = bits; b; b &= b - 1)
+            dst [__builtin_ctz (b) * capWidth] = color;
+      }
+      else
+      {
+         for (uint32_t b = bits; b; b &= b - 1)
+            std::fill_n (dst + __builtin_ctz (b) * capWidth, n, color);
+      }
+
+      posX += n;
+      width = std::max (width, posX);
+      height = std::max (height, posY + topBit + 1);
+   }
+
+   // Make room for w x h pixels, growing geometrically to amortize copying
+   bool
+   SixelDecoder::reserve (int w, int h)
+   {
+      if (w <= capWidth && h <= capHeight)
+         return true;
+      if (w > maxImageSize || h > maxImageSize)
+         return false;
+
+      const int newWidth = w <= capWidth
+                         ? capWidth
+                         : std::min (maxImageSize, std::max (w, 2 * capWidth));
+      const int newHeight = h <= capHeight
+                          ? capHeight
+                          : std::min (maxImageSize,
+                                      std::max (h, 2 * capHeight));
+
+      std::vector <uint32_t> grown (newWidth * newHeight, fill);
+      for (int y = 0; y < capHeight; ++y)
+         std::copy_n (pixels.data () + y * capWidth, capWidth,
+                      grown.data () + y * newWidth);
+      pixels.swap (grown);
+      capWidth = newWidth;
+      capHeight = newHeight;
+      return true;
+   }
+
+} // namespace zutty
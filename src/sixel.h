@@ -0,0 +1,67 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "base.h"
+#include "image.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace zutty
+{
+   /* Streaming decoder of DEC sixel graphics. The DCS string data (after
+    * the introducing 'q') is fed in arbitrary pieces, as it is read from
+    * the pty, so the payload is never buffered as a whole; only the image
+    * being decoded is kept, growing as needed.
+    */
+   class SixelDecoder
+   {
+   public:
+      // Start a new image. Unless transparent (P2 = 1 in the DCS string),
+      // pixels not set by the image get the background color.
+      void begin (bool transparent, const Color& bg);
+
+      void feed (const unsigned char* data, size_t len);
+
+      // Return the decoded image (nullptr if empty) and release buffers
+      ImagePtr finish ();
+
+   private:
+      enum class State: uint8_t { Data, Repeat, Color, Raster };
+      constexpr const static int maxParams = 5;
+
+      State state = State::Data;
+      uint32_t params [maxParams];
+      int nParams = 0;
+      uint32_t repeat = 1;
+
+      uint32_t palette [256]; // RGBA, as laid out in memory
+      uint32_t color = 0;
+      uint32_t fill = 0;      // for pixels not set by the image
+
+      int posX = 0;
+      int posY = 0;           // top of the current band of six rows
+      int width = 0;          // extent of the image so far
+      int height = 0;
+      int rasterWidth = 0;    // size declared by the raster attributes
+      int rasterHeight = 0;
+      int capWidth = 0;       // allocated size of pixels
+      int capHeight = 0;
+      std::vector <uint32_t> pixels;
+
+      void endCommand ();
+      void putSixel (uint32_t bits, uint32_t count);
+      bool reserve (int w, int h);
+   };
+
+} // namespace zutty
@@ -0,0 +1,730 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "softvdev.h"
+#include "log.h"
+#include "options.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+   using namespace zutty;
+
+   // Minimum number of cells to render for splitting work across threads
+   constexpr const int parallelCells = 2048;
+
+   // Damage overlay: heat of a cell, and the flag of a full redraw
+   constexpr const uint8_t heatLevel = 0x7f;
+   constexpr const uint8_t heatFull = 0x80;
+
+   // Mix a tint into c (up to half of it, at the maximum heat level)
+   inline Color
+   tintColor (const Color& c, const Color& tint, int level)
+   {
+      const int w = 128 * level / CharVdev::damageFadeFrames;
+      auto mix = [w] (int a, int b) { return uint8_t (a + (b - a) * w / 256); };
+      return Color {mix (c.red, tint.red), mix (c.green, tint.green),
+                    mix (c.blue, tint.blue)};
+   }
+
+   // Exact for v <= 255 * 255 + 127, as used below
+   inline uint32_t
+   div255 (uint32_t v)
+   {
+      return (v + 1 + (v >> 8)) >> 8;
+   }
+
+   /* Alpha blend a row of glyph pixels. Kept free of branches and aliasing
+    * so that the compiler can auto-vectorize it.
+    */
+   inline void
+   blendRow (uint32_t* __restrict dst, const uint8_t* __restrict lumi, int n,
+             const uint32_t fg [3], const uint32_t bg [3],
+             int shiftR, int shiftG, int shiftB)
+   {
+      for (int j = 0; j < n; ++j)
+      {
+         const uint32_t l = lumi [j];
+         const uint32_t r = div255 (fg [0] * l + bg [0] * (255 - l) + 127);
+         const uint32_t g = div255 (fg [1] * l + bg [1] * (255 - l) + 127);
+         const uint32_t b = div255 (fg [2] * l + bg [2] * (255 - l) + 127);
+         dst [j] = (r << shiftR) | (g << shiftG) | (b << shiftB);
+      }
+   }
+
+   inline void
+   fillRow (uint32_t* dst, int n, uint32_t pixel)
+   {
+      std::fill (dst, dst + n, pixel);
+   }
+
+   int
+   maskShift (unsigned long mask)
+   {
+      int shift = 0;
+      while (mask && !(mask & 1))
+      {
+         mask >>= 1;
+         ++shift;
+      }
+      if (mask != 0xff)
+         throw std::runtime_error ("Software rendering requires 8-bit "
+                                   "color channels");
+      return shift;
+   }
+
+   // MIT-SHM only works if the X server runs on the same host
+   bool
+   isLocalDisplay (Display* dpy)
+   {
+      const char* name = DisplayString (dpy);
+      return name [0] == ':' || strncmp (name, "unix:", 5) == 0;
+   }
+
+   /* Attaching a segment fails with an X error if the server can't access
+    * it (e.g., in a separate IPC namespace). Such errors on the display
+    * being attached are caught here while attaching; all others go to the
+    * handler installed by main ().
+    */
+   std::mutex shmErrorMx;
+   Display* shmErrorDpy = nullptr;
+   bool shmError = false;
+   XErrorHandler prevErrorHandler = nullptr;
+
+   int
+   handleShmError (Display* dpy, XErrorEvent* ev)
+   {
+      if (dpy == shmErrorDpy)
+      {
+         shmError = true;
+         return 0;
+      }
+      return prevErrorHandler ? prevErrorHandler (dpy, ev) : 0;
+   }
+
+} // namespace
+
+namespace zutty
+{
+   SoftVdev::SoftVdev (Fontpack* fontpk, Window window_)
+      : px (fontpk->getPx ())
+      , py (fontpk->getPy ())
+      , window (window_)
+   {
+      // Use a separate connection, so that our requests and replies
+      // do not interfere with event processing in the main thread.
+      dpy = XOpenDisplay (opts.display);
+      if (!dpy)
+         throw std::runtime_error ("SoftVdev: couldn't open display");
+      gc = XCreateGC (dpy, window, 0, nullptr);
+
+      XWindowAttributes wa;
+      XGetWindowAttributes (dpy, window, &wa);
+      visual = wa.visual;
+      depth = wa.depth;
+      if (visual->c_class != TrueColor || depth < 24)
+         throw std::runtime_error ("Software rendering requires a "
+                                   "TrueColor visual of depth 24 or 32");
+      shiftR = maskShift (visual->red_mask);
+      shiftG = maskShift (visual->green_mask);
+      shiftB = maskShift (visual->blue_mask);
+
+      useShm = isLocalDisplay (dpy) && XShmQueryExtension (dpy);
+      nThreads = std::max (1u, std::min (8u,
+                                         std::thread::hardware_concurrency ()));
+
+      logI << "Software rendering: MIT-SHM "
+           << (useShm ? "enabled" : "disabled") << ", "
+           << nThreads << " thread(s)" << std::endl;
+
+      // Fonts are used directly from memory, so we don't release them
+      const Font& reg = fontpk->getRegular ();
+      atlas.stride = reg.getPx () * reg.getNx ();
+      atlas.lookup = fontpk->getAtlasLookup (false);
+
+      atlasData [0] = reg.getAtlasData ();
+      atlasData [1] = fontpk->hasBold ()
+                    ? fontpk->getBold ().getAtlasData ()
+                    : atlasData [0];
+      atlasData [2] = fontpk->hasItalic ()
+                    ? fontpk->getItalic ().getAtlasData ()
+                    : atlasData [0];
+      if (fontpk->hasBoldItalic ())
+         atlasData [3] = fontpk->getBoldItalic ().getAtlasData ();
+      else if (fontpk->hasItalic ())
+         atlasData [3] = atlasData [2];
+      else
+         atlasData [3] = atlasData [1];
+
+      if (fontpk->hasDoubleWidth ())
+      {
+         const Font& dw = fontpk->getDoubleWidth ();
+         atlas_dw.data = dw.getAtlasData ();
+         atlas_dw.stride = dw.getPx () * dw.getNx ();
+         atlas_dw.lookup = fontpk->getAtlasLookup (true);
+      }
+
+      for (unsigned band = 1; band < nThreads; ++band)
+         workers.emplace_back (&SoftVdev::runWorker, this, band);
+   }
+
+   SoftVdev::~SoftVdev ()
+   {
+      {
+         std::lock_guard <std::mutex> lk (poolMx);
+         quit = true;
+      }
+      poolCond.notify_all ();
+      for (auto& w: workers)
+         w.join ();
+
+      destroyImage ();
+      XFreeGC (dpy, gc);
+      XCloseDisplay (dpy);
+   }
+
+   bool
+   SoftVdev::resize (uint16_t pxWidth_, uint16_t pxHeight_)
+   {
+      if (pxWidth == pxWidth_ && pxHeight == pxHeight_)
+         return false;
+
+      pxWidth = pxWidth_;
+      pxHeight = pxHeight_;
+      nCols = std::max (1, (pxWidth - 2 * opts.border) / px);
+      nRows = std::max (1, (pxHeight - 2 * opts.border) / py);
+
+      logI << "Resize to " << pxWidth << " x " << pxHeight
+           << " pixels, " << nCols << " x " << nRows << " chars"
+           << std::endl;
+
+      destroyImage ();
+      createImage ();
+      cells.assign (nCols * nRows, Cell ());
+      if (opts.showDamage)
+         heat.assign (nCols * nRows, 0);
+      fullDamage = true;
+
+      return true;
+   }
+
+   SoftVdev::Mapping
+   SoftVdev::getMapping ()
+   {
+      return Mapping {nCols, nRows, cells.data ()};
+   }
+
+   void
+   SoftVdev::setCursor (const CharVdev::Cursor& cursor_)
+   {
+      prevCursorPos = Point (cursor.posX, cursor.posY);
+      cursor = cursor_;
+      addDamage (Rect (cursor.posX, cursor.posY, cursor.posX + 2, cursor.posY));
+      addDamage (Rect (prevCursorPos.x, prevCursorPos.y,
+                       prevCursorPos.x + 2, prevCursorPos.y));
+   }
+
+   void
+   SoftVdev::setSelection (const Rect& sel, const Rect& area)
+   {
+      Rect damage (std::min (sel.tl, selection.tl),
+                   std::max (sel.br, selection.br));
+      selectDamageStart = nCols * damage.tl.y + damage.tl.x;
+      selectDamageEnd = nCols * damage.br.y + damage.br.x + 1;
+      if (sel.tl != selection.tl || sel.br != selection.br ||
+          sel.rectangular != selection.rectangular)
+         addDamage (Rect (0, damage.tl.y, nCols, damage.br.y));
+      selection = sel;
+      selectArea = area.null () ? Rect (0, 0, nCols, nRows) : area;
+   }
+
+   void
+   SoftVdev::setDeltaFrame (bool delta_)
+   {
+      delta = delta_;
+      if (!delta)
+         fullDamage = true;
+   }
+
+   void
+   SoftVdev::addDamage (const Rect& cells)
+   {
+      if (cells.null ())
+         return;
+
+      Rect r (std::max (0, cells.tl.x), std::max (0, cells.tl.y),
+              std::min ((int)nCols, cells.br.x),
+              std::min (nRows - 1, cells.br.y));
+      if (r.tl.x >= r.br.x || r.tl.y > r.br.y)
+         return;
+
+      if (damage.null ())
+      {
+         damage = r;
+         return;
+      }
+      damage.tl.x = std::min (damage.tl.x, r.tl.x);
+      damage.tl.y = std::min (damage.tl.y, r.tl.y);
+      damage.br.x = std::max (damage.br.x, r.br.x);
+      damage.br.y = std::max (damage.br.y, r.br.y);
+   }
+
+   void
+   SoftVdev::setImages (const std::vector <ImagePlacement>& images_)
+   {
+      for (const auto& p: images)
+         if (std::find (images_.begin (), images_.end (), p) == images_.end ())
+            addDamage (p.cellRect ());
+      for (const auto& p: images_)
+         if (std::find (images.begin (), images.end (), p) == images.end ())
+            addDamage (p.cellRect ());
+      images = images_;
+   }
+
+   Rect
+   SoftVdev::draw ()
+   {
+      if (damage.tl == Point (0, 0) && damage.br == Point (nCols, nRows - 1))
+         fullDamage = true; // also present the border around the cells
+
+      int startRow = 0;
+      int endRow = nRows;
+      if (fullDamage)
+      {
+         const uint32_t bg = pixel (opts.bg);
+         uint32_t* p = reinterpret_cast <uint32_t*> (image->data);
+         for (int k = 0; k < pxHeight; ++k)
+            fillRow (p + k * image->bytes_per_line / 4, pxWidth, bg);
+      }
+      else if (opts.showDamage)
+      {
+         // The tint of cells damaged by earlier frames may be fading
+         // anywhere, so go through all of them
+      }
+      else if (!damage.null ())
+      {
+         startRow = damage.tl.y;
+         endRow = damage.br.y + 1;
+      }
+      else
+      {
+         // Nothing to draw or to present (the result is only informative,
+         // as the frame is presented here)
+         return Rect ();
+      }
+
+      const int nBands = std::min ((int)nThreads,
+                                   (endRow - startRow) * nCols / parallelCells);
+      if (nBands > 1)
+      {
+         const int rowsPerBand = (endRow - startRow + nBands - 1) / nBands;
+         {
+            std::lock_guard <std::mutex> lk (poolMx);
+            jobStartRow = startRow;
+            jobEndRow = endRow;
+            jobBandRows = rowsPerBand;
+            pending = workers.size ();
+            ++generation;
+         }
+         poolCond.notify_all ();
+         drawRows (startRow, std::min (startRow + rowsPerBand, endRow));
+
+         std::unique_lock <std::mutex> lk (poolMx);
+         poolDoneCond.wait (lk, [this] () { return pending == 0; });
+      }
+      else
+      {
+         drawRows (startRow, endRow);
+      }
+      drawImages (startRow, endRow);
+
+      // Present the damaged area (top-left origin in X coordinates)
+      int x = 0, y = 0, w = pxWidth, h = pxHeight;
+      Rect damagePx;
+      if (!fullDamage && !damage.null () && !opts.showDamage)
+      {
+         x = opts.border + damage.tl.x * px;
+         y = opts.border + damage.tl.y * py;
+         w = std::min ((damage.br.x - damage.tl.x) * px, pxWidth - x);
+         h = (damage.br.y - damage.tl.y + 1) * py;
+         damagePx = Rect (x, pxHeight - y - h, x + w, pxHeight - y);
+      }
+      damage.clear ();
+      fullDamage = false;
+
+      if (useShm)
+         XShmPutImage (dpy, window, gc, image, x, y, x, y, w, h, False);
+      else
+         XPutImage (dpy, window, gc, image, x, y, x, y, w, h);
+      // Wait until the server is done with the image, as we will write it
+      XSync (dpy, False);
+
+      return damagePx;
+   }
+
+   // private methods
+
+   void
+   SoftVdev::createImage ()
+   {
+      if (useShm && !createShmImage ())
+      {
+         logW << "Software rendering: MIT-SHM not usable, "
+              << "falling back to XPutImage" << std::endl;
+         useShm = false;
+      }
+
+      if (!useShm)
+      {
+         char* data = reinterpret_cast <char*> (
+            malloc (4 * pxWidth * pxHeight));
+         if (!data)
+            throw std::runtime_error ("SoftVdev: out of memory");
+         image = XCreateImage (dpy, visual, depth, ZPixmap, 0, data,
+                               pxWidth, pxHeight, 32, 0);
+      }
+      assert (image->bits_per_pixel == 32);
+   }
+
+   // Create image in a shared memory segment attached by the X server
+   bool
+   SoftVdev::createShmImage ()
+   {
+      image = XShmCreateImage (dpy, visual, depth, ZPixmap, nullptr,
+                               &shmInfo, pxWidth, pxHeight);
+      if (!image)
+         return false;
+
+      shmInfo.shmid = shmget (IPC_PRIVATE,
+                              image->bytes_per_line * image->height,
+                              IPC_CREAT | 0600);
+      if (shmInfo.shmid < 0)
+      {
+         logW << "shmget: " << strerror (errno) << std::endl;
+         XDestroyImage (image);
+         image = nullptr;
+         return false;
+      }
+      shmInfo.shmaddr = image->data =
+         reinterpret_cast <char*> (shmat (shmInfo.shmid, nullptr, 0));
+      if (shmInfo.shmaddr == reinterpret_cast <char*> (-1))
+      {
+         logW << "shmat: " << strerror (errno) << std::endl;
+         shmctl (shmInfo.shmid, IPC_RMID, nullptr);
+         image->data = nullptr;
+         XDestroyImage (image);
+         image = nullptr;
+         return false;
+      }
+      shmInfo.readOnly = False;
+
+      bool attached;
+      {
+         std::lock_guard <std::mutex> lk (shmErrorMx);
+         shmErrorDpy = dpy;
+         shmError = false;
+         prevErrorHandler = XSetErrorHandler (handleShmError);
+         attached = XShmAttach (dpy, &shmInfo);
+         XSync (dpy, False);
+         XSetErrorHandler (prevErrorHandler);
+         attached = attached && !shmError;
+         shmErrorDpy = nullptr;
+      }
+
+      // Mark for removal; it will be freed once we detach
+      shmctl (shmInfo.shmid, IPC_RMID, nullptr);
+      if (!attached)
+      {
+         logW << "XShmAttach failed" << std::endl;
+         XDestroyImage (image);
+         shmdt (shmInfo.shmaddr);
+         image = nullptr;
+         return false;
+      }
+      return true;
+   }
+
+   void
+   SoftVdev::destroyImage ()
+   {
+      if (!image)
+         return;
+
+      if (useShm)
+      {
+         XShmDetach (dpy, &shmInfo);
+         XDestroyImage (image);
+         shmdt (shmInfo.shmaddr);
+      }
+      else
+      {
+         XDestroyImage (image); // also frees the pixel data
+      }
+      image = nullptr;
+   }
+
+   uint32_t
+   SoftVdev::pixel (const Color& c) const
+   {
+      return (c.red << shiftR) | (c.green << shiftG) | (c.blue << shiftB);
+   }
+
+   // N.B.: mirrors the selection logic of the CharVdev compute shader
+   bool
+   SoftVdev::isSelected (int x, int y) const
+   {
+      const Rect& s = selection;
+      if (x < selectArea.tl.x || x >= selectArea.br.x ||
+          y < selectArea.tl.y || y >= selectArea.br.y)
+         return false;
+      if (s.rectangular)
+         return (y >= s.tl.y && y <= s.br.y && x >= s.tl.x && x < s.br.x);
+
+      return ((y > s.tl.y && y < s.br.y) ||
+              (y == s.tl.y && x >= s.tl.x && (y < s.br.y || x < s.br.x)) ||
+              (y == s.br.y && x < s.br.x && (y > s.tl.y || x > s.tl.x)));
+   }
+
+   bool
+   SoftVdev::needsDraw (int x, int y) const
+   {
+      if (!delta)
+         return true;
+
+      const int idx = nCols * y + x;
+      return (cells [idx].dirty ||
+              (x == cursor.posX && y == cursor.posY) ||
+              (x == prevCursorPos.x && y == prevCursorPos.y) ||
+              (idx >= selectDamageStart && idx < selectDamageEnd));
+   }
+
+   bool
+   SoftVdev::isUnderImage (int x, int y) const
+   {
+      for (const auto& p: images)
+         if (y >= p.row && y < p.row + p.rows &&
+             x >= p.col && x < p.col + p.cols)
+            return true;
+      return false;
+   }
+
+   void
+   SoftVdev::runWorker (int band)
+   {
+      uint64_t seen = 0;
+      for (;;)
+      {
+         int startRow, endRow;
+         {
+            std::unique_lock <std::mutex> lk (poolMx);
+            poolCond.wait (lk, [&] () { return quit || generation != seen; });
+            if (quit)
+               return;
+            seen = generation;
+            startRow = jobStartRow + band * jobBandRows;
+            endRow = std::min (startRow + jobBandRows, jobEndRow);
+         }
+
+         if (startRow < endRow)
+            drawRows (startRow, endRow);
+
+         std::lock_guard <std::mutex> lk (poolMx);
+         if (--pending == 0)
+            poolDoneCond.notify_one ();
+      }
+   }
+
+   /* Cells under images are always redrawn within the drawn rows, so that
+    * images can be blended over them without leaving stale pixels behind.
+    */
+   void
+   SoftVdev::drawRows (int startRow, int endRow)
+   {
+      for (int y = startRow; y < endRow; ++y)
+         for (int x = 0; x < nCols; ++x)
+         {
+            const int idx = nCols * y + x;
+            if (fullDamage || needsDraw (x, y))
+            {
+               if (opts.showDamage)
+                  heat [idx] = CharVdev::damageFadeFrames |
+                               (fullDamage ? heatFull : 0);
+               drawCell (x, y);
+            }
+            else if (opts.showDamage && (heat [idx] & heatLevel))
+            {
+               --heat [idx];
+               drawCell (x, y);
+            }
+            else if (isUnderImage (x, y))
+               drawCell (x, y);
+         }
+   }
+
+   // Blend images over the cells, nearest neighbour scaled to size
+   void
+   SoftVdev::drawImages (int startRow, int endRow)
+   {
+      const int stride = image->bytes_per_line / 4;
+      uint32_t* const base = reinterpret_cast <uint32_t*> (image->data);
+
+      for (const auto& p: images)
+      {
+         const Image& img = *p.image;
+         const int srcW = p.src.br.x - p.src.tl.x;
+         const int srcH = p.src.br.y - p.src.tl.y;
+         const int x0 = opts.border + p.col * px;
+         const int y0 = opts.border + p.row * py;
+         const int xEnd = std::min (x0 + (int)p.width,
+                                    opts.border + nCols * px);
+         const int yBegin = std::max (y0, opts.border + startRow * py);
+         const int yEnd = std::min (y0 + (int)p.height,
+                                    opts.border + endRow * py);
+
+         for (int y = yBegin; y < yEnd; ++y)
+         {
+            const int sy = p.src.tl.y + (y - y0) * srcH / p.height;
+            const uint8_t* srcRow = img.rgba.data () + 4 * sy * img.width;
+            uint32_t* dst = base + y * stride;
+            for (int x = x0; x < xEnd; ++x)
+            {
+               const int sx = p.src.tl.x + (x - x0) * srcW / p.width;
+               const uint8_t* s = srcRow + 4 * sx;
+               const uint32_t a = s [3];
+               if (a == 0)
+                  continue;
+               const uint32_t d = dst [x];
+               const uint32_t r = div255 (s [0] * a + ((d >> shiftR) & 0xff) *
+                                          (255 - a) + 127);
+               const uint32_t g = div255 (s [1] * a + ((d >> shiftG) & 0xff) *
+                                          (255 - a) + 127);
+               const uint32_t b = div255 (s [2] * a + ((d >> shiftB) & 0xff) *
+                                          (255 - a) + 127);
+               dst [x] = (r << shiftR) | (g << shiftG) | (b << shiftB);
+            }
+         }
+      }
+   }
+
+   void
+   SoftVdev::drawCell (int x, int y)
+   {
+      using Style = CharVdev::Cursor::Style;
+
+      const int idx = nCols * y + x;
+      Cell& cell = cells [idx];
+      cell.dirty = 0;
+      if (cell.dwidth_cont) // double-width cell continuation
+         return;
+
+      bool dwidth = cell.dwidth;
+      if (dwidth && x < nCols - 1 && !cells [idx + 1].dwidth_cont)
+         dwidth = false;
+
+      Color fg = cell.fg;
+      Color bg = cell.bg;
+      if (cell.inverse ^ isSelected (x, y))
+         std::swap (fg, bg);
+
+      Color cr = cursor.color;
+      if (cr == bg)
+         cr = Color {uint8_t (255 - cr.red), uint8_t (255 - cr.green),
+                     uint8_t (255 - cr.blue)};
+
+      const bool atCursor = (x == cursor.posX && y == cursor.posY);
+      if (atCursor && cursor.style == Style::filled_block)
+      {
+         fg = bg;
+         bg = cr;
+      }
+
+      // Damage overlay -- red: full redraw; green: delta frame
+      if (opts.showDamage && (heat [idx] & heatLevel))
+      {
+         const Color tint = (heat [idx] & heatFull) ? Color {255, 0, 0}
+                                                    : Color {0, 255, 0};
+         fg = tintColor (fg, tint, heat [idx] & heatLevel);
+         bg = tintColor (bg, tint, heat [idx] & heatLevel);
+      }
+
+      const uint32_t fgc [3] = {fg.red, fg.green, fg.blue};
+      const uint32_t bgc [3] = {bg.red, bg.green, bg.blue};
+
+      const int srcW = dwidth ? 2 * px : px;
+      const int w = std::min (srcW, (nCols - x) * px); // clip at right edge
+      const int stride = image->bytes_per_line / 4;
+      uint32_t* const dst = reinterpret_cast <uint32_t*> (image->data) +
+                            (opts.border + y * py) * stride +
+                            opts.border + x * px;
+
+      const Atlas& a = dwidth ? atlas_dw : atlas;
+      if (dwidth && !atlas_dw.data)
+      {  // no double-width font -- draw an empty box
+         std::vector <uint8_t> lumi (srcW);
+         for (int k = 0; k < py; ++k)
+         {
+            for (int j = 0; j < srcW; ++j)
+               lumi [j] = ((0 < j && j < srcW - 1) && (0 < k && k < py - 1) &&
+                           (j == 1 || j == srcW - 2 || k == 1 || k == py - 2))
+                        ? 179 : 0;
+            blendRow (dst + k * stride, lumi.data (), w, fgc, bgc,
+                      shiftR, shiftG, shiftB);
+         }
+      }
+      else if (a.lookup [cell.uc_pt].x == 0 && a.lookup [cell.uc_pt].y == 0)
+      {  // blank glyph -- fill with background, no need to read the atlas
+         const uint32_t bgp = pixel (bg);
+         for (int k = 0; k < py; ++k)
+            fillRow (dst + k * stride, w, bgp);
+      }
+      else
+      {
+         const uint8_t* data = dwidth
+                             ? atlas_dw.data
+                             : atlasData [cell.bold + 2 * cell.italic];
+         const Font::AtlasPos ap = a.lookup [cell.uc_pt];
+         const uint8_t* src = data + ap.y * py * a.stride + ap.x * srcW;
+         for (int k = 0; k < py; ++k)
+            blendRow (dst + k * stride, src + k * a.stride, w, fgc, bgc,
+                      shiftR, shiftG, shiftB);
+      }
+
+      if (cell.underline)
+         fillRow (dst + (py - 1) * stride, w, pixel (fg));
+
+      if (opts.showWraps && cell.wrap && srcW <= w)
+         for (int k = 0; k < py; k += 2)
+            dst [k * stride + srcW - 1] = pixel (fg);
+
+      if (atCursor && cursor.style == Style::hollow_block)
+      {
+         const uint32_t crp = pixel (cr);
+         fillRow (dst, w, crp);
+         fillRow (dst + (py - 1) * stride, w, crp);
+         for (int k = 1; k < py - 1; ++k)
+         {
+            dst [k * stride] = crp;
+            if (srcW <= w)
+               dst [k * stride + srcW - 1] = crp;
+         }
+      }
+   }
+
+} // namespace zutty
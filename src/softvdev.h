@@ -0,0 +1,136 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "charvdev.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zutty
+{
+   /* Software rendering backend: a drop-in replacement for CharVdev that
+    * rasterizes cells on the CPU, without any need for OpenGL. Glyphs are
+    * blended from the same font atlases as used by CharVdev, splitting
+    * larger updates into row bands rendered by a pool of worker threads.
+    * The result is presented with XShmPutImage, or XPutImage where the
+    * MIT-SHM extension is not available (e.g., remote X sessions).
+    *
+    * Unlike CharVdev, draw () also takes care of presenting the frame.
+    */
+   class SoftVdev
+   {
+   public:
+      SoftVdev (Fontpack* fontpk, Window window);
+
+      ~SoftVdev ();
+
+      bool resize (uint16_t pxWidth_, uint16_t pxHeight_);
+      Rect draw ();
+
+      using Cell = CharVdev::Cell;
+
+      struct Mapping
+      {
+         uint16_t nCols;
+         uint16_t nRows;
+         Cell * cells;
+      };
+
+      Mapping getMapping ();
+
+      // No GPU to measure (see CharVdev::getGpuTimes)
+      std::vector <std::string> getGpuTimes () const { return {}; }
+
+      void setCursor (const CharVdev::Cursor& cursor);
+      void setSelection (const Rect& selection, const Rect& area = Rect ());
+      void setDeltaFrame (bool delta);
+      void addDamage (const Rect& damage);
+      void setImages (const std::vector <ImagePlacement>& images);
+
+   private:
+      uint16_t px;
+      uint16_t py;
+      uint16_t nCols = 0;
+      uint16_t nRows = 0;
+      uint16_t pxWidth = 0;
+      uint16_t pxHeight = 0;
+
+      struct Atlas
+      {
+         const uint8_t* data = nullptr;
+         int stride = 0; // bytes per atlas row
+         std::vector <Font::AtlasPos> lookup;
+      };
+      const uint8_t* atlasData [4]; // Regular, Bold, Italic, BoldItalic
+      Atlas atlas;
+      Atlas atlas_dw;
+
+      std::vector <Cell> cells;
+      std::vector <uint8_t> heat; // of each cell, for showDamage
+      CharVdev::Cursor cursor;
+      Point prevCursorPos {0, 0};
+      Rect selection;
+      Rect selectArea;  // bottom right exclusive
+      int selectDamageStart = 0;
+      int selectDamageEnd = 0;
+      bool delta = false;
+      Rect damage;
+      bool fullDamage = true;
+      std::vector <ImagePlacement> images; // drawn on top of the cells
+
+      Display* dpy = nullptr;
+      Window window;
+      Visual* visual;
+      int depth;
+      GC gc;
+      XImage* image = nullptr;
+      XShmSegmentInfo shmInfo {};
+      bool useShm = false;
+      int shiftR, shiftG, shiftB;
+      unsigned nThreads;
+
+      // Worker threads, each drawing its own row band (the calling thread
+      // draws band 0) of the job published by incrementing generation
+      std::vector <std::thread> workers;
+      std::mutex poolMx;
+      std::condition_variable poolCond;
+      std::condition_variable poolDoneCond;
+      uint64_t generation = 0;
+      int jobStartRow = 0;
+      int jobEndRow = 0;
+      int jobBandRows = 0;
+      int pending = 0; // workers yet to finish the current job
+      bool quit = false;
+
+      void createImage ();
+      bool createShmImage ();
+      void destroyImage ();
+      uint32_t pixel (const Color& c) const;
+      bool isSelected (int x, int y) const;
+      bool needsDraw (int x, int y) const;
+      bool isUnderImage (int x, int y) const;
+      void runWorker (int band);
+      void drawRows (int startRow, int endRow);
+      void drawCell (int x, int y);
+      void drawImages (int startRow, int endRow);
+   };
+
+} // namespace zutty
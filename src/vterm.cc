@@ -10,10 +10,14 @@
  */
 
 #include "options.h"
+#include "probe.h"
 #include "pty.h"
 #include "vterm.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
+#include <sstream>
 
 namespace
 {
@@ -21,6 +25,13 @@ namespace
    using Key = VtKey;
    using InputSpec = Vterm::InputSpec;
 
+   // Trailing delay of pty resizes, see Vterm::flushPtyResize ()
+   const std::chrono::milliseconds ptyResizeDelay (50);
+
+   // Limits of APC strings and of chunked kitty graphics transmissions
+   constexpr const size_t maxApcLength = 64 * 1024;
+   constexpr const size_t maxKittyPayload = maxImageBytes / 3 * 4 + 4;
+
    #define ESC "\x1b"
    #define CSI ESC "["
    #define SS3 ESC "O"
@@ -555,6 +566,17 @@ namespace
       0x0078, 0x0079, 0x007a, 0x007b, 0x007c, 0x007d, 0x007e, 0x007f,
    };
 
+   // For the summary of unhandled input (see DiagCounter)
+   std::string
+   describeChar (unsigned char ch)
+   {
+      std::ostringstream oss;
+      oss << "char " << (int)ch;
+      if (ch >= ' ' && ch < 0x7f)
+         oss << " '" << ch << "'";
+      return oss.str ();
+   }
+
 } // namespace
 
 namespace zutty
@@ -582,9 +604,29 @@ namespace zutty
       , glyphPy (glyphPy_)
       , ptyFd (ptyFd_)
       , onRefresh ([] (const Frame&) {})
-      , onOsc ([] (int cmd, const std::string& arg)
-               { logU << "OSC: '" << cmd << ";" << arg << "'" << std::endl; })
+      , onOsc ([this] (int cmd, const std::string& arg)
+               {
+                  logT << "OSC: '" << cmd << ";" << arg << "'" << std::endl;
+                  unhandledSeqDiag.count (diagKey (InputState::OSC,
+                                                   std::max (cmd, 0)));
+               })
       , onBell ([] () { logI << "* Bell *" << std::endl; })
+      , unhandledInputDiag ("Unhandled input", true,
+                            [this] (uint32_t key)
+                            {
+                               return describeChar (key & 0xff) +
+                                  " in state " +
+                                  strInputState ((InputState)(key >> 16));
+                            })
+      , unhandledSeqDiag ("Sequence", false,
+                          [this] (uint32_t key)
+                          {
+                             const auto state = (InputState)(key >> 16);
+                             if (state == InputState::OSC)
+                                return "OSC " + std::to_string (key & 0xffff);
+                             return std::string (strInputState (state)) +
+                                " starting with " + describeChar (key & 0xff);
+                          })
       , frame_pri (winPx, winPy, nCols, nRows, marginTop, marginBottom,
                    opts.saveLines)
       , cf (&frame_pri)
@@ -669,6 +711,7 @@ namespace zutty
       }
       nCols = nCols_;
       nRows = nRows_;
+      PROBE2 (resize, nCols, nRows);
 
       if (horizMarginMode)
       {
@@ -683,7 +726,52 @@ namespace zutty
       normalizeCursorPos ();
       showCursor ();
 
+      ptyResizePending = true;
+      ptyResizeDue = std::chrono::steady_clock::now () + ptyResizeDelay;
+   }
+
+   int
+   Vterm::runTimers ()
+   {
+      int timeout = -1;
+      for (int t: {flushPtyResize (), checkSyncOutputTimeout (),
+                   unhandledInputDiag.flush (), unhandledSeqDiag.flush ()})
+         if (t >= 0 && (timeout < 0 || t < timeout))
+            timeout = t;
+      return timeout;
+   }
+
+   int
+   Vterm::flushPtyResize ()
+   {
+      if (!ptyResizePending)
+         return -1;
+
+      using namespace std::chrono;
+      auto now = steady_clock::now ();
+      if (now < ptyResizeDue)
+         return 1 + duration_cast <milliseconds> (ptyResizeDue - now).count ();
+
+      ptyResizePending = false;
       pty_resize (ptyFd, nCols, nRows);
+      return -1;
+   }
+
+   int
+   Vterm::checkSyncOutputTimeout ()
+   {
+      if (!syncOutputMode)
+         return -1;
+
+      using namespace std::chrono;
+      auto now = steady_clock::now ();
+      if (now < syncOutputDeadline)
+         return 1 + duration_cast <milliseconds> (syncOutputDeadline - now).count ();
+
+      logT << "Synchronized output mode timed out" << std::endl;
+      syncOutputMode = false;
+      redraw ();
+      return -1;
    }
 
    std::string
@@ -1018,6 +1106,8 @@ namespace zutty
    void
    Vterm::processInput (const unsigned char *const input, int inputSize)
    {
+      PROBE1 (input_begin, inputSize);
+      curInput = input;
       lastEscBegin = 0;
       lastNormalBegin = 0;
       lastStopPos = 0;
@@ -1144,6 +1234,7 @@ namespace zutty
             case 'N': charsetState.ss = 2; setState (InputState::Normal); break;
             case 'O': charsetState.ss = 3; setState (InputState::Normal); break;
             case 'P': argBuf.clear (); setState (InputState::DCS); break;
+            case '_': argBuf.clear (); setState (InputState::APC); break;
             case 'c': esc_RIS (); break;
             case '6': esc_BI (); break;
             case '7': esc_DECSC (); break;
@@ -1303,7 +1394,17 @@ namespace zutty
             case '\t': inp_HT (); setState (InputState::CSI); break;
             case '\r': inp_CR (); setState (InputState::CSI); break;
             case '\f': // fall through
-            case '\v': esc_IND (); setState (InputState::CSI); break;
+            case '\v': // esc_IND resets the parameters collected so far
+            {
+               uint32_t savedOps [maxEscOps];
+               size_t nSavedOps = nInputOps;
+               std::copy (inputOps, inputOps + nSavedOps, savedOps);
+               esc_IND ();
+               std::copy (savedOps, savedOps + nSavedOps, inputOps);
+               nInputOps = nSavedOps;
+               setState (InputState::CSI);
+               break;
+            }
             // N.B. '>' and '?' above, so no IGNORE_SEQUENCE_ON_BAD_PARAMS:
             case ':': case '<': case '=':
                setState (InputState::IgnoreSequence);
@@ -1362,6 +1463,15 @@ namespace zutty
             case '\e': setState (InputState::Normal); break;
             case 'h': csi_privSM (); break;
             case 'l': csi_privRM (); break;
+            case '$': setState (InputState::CSI_priv_Dollar); break;
+            IGNORE_SEQUENCE_ON_BAD_PARAMS;
+            default: unhandledInput (ch); break;
+            }
+            break;
+         case InputState::CSI_priv_Dollar:
+            switch (ch)
+            {
+            case 'p': csi_privDECRQM (); break;
             IGNORE_SEQUENCE_ON_BAD_PARAMS;
             default: unhandledInput (ch); break;
             }
@@ -1370,6 +1480,15 @@ namespace zutty
             switch (ch)
             {
             case '\e': setState (InputState::DCS_Esc); break;
+            case 'q':
+               if (std::all_of (argBuf.begin (), argBuf.end (),
+                                [] (unsigned char c)
+                                { return isdigit (c) || c == ';'; }))
+               {
+                  dcs_SixelBegin ();
+                  break;
+               }
+               // fall through
             default:
                if (argBuf.size () < 4095)
                   argBuf.push_back (ch);
@@ -1392,6 +1511,43 @@ namespace zutty
                break;
             }
             break;
+         case InputState::DCS_Sixel:
+            switch (ch)
+            {
+            case '\e': setState (InputState::DCS_Sixel_Esc); break;
+            case '\x18': case '\x1a': // CAN and SUB abort the image
+               sixelDecoder.finish ();
+               setState (InputState::Normal);
+               break;
+            default:
+            {
+               // Hand everything up to the end of the string (or the
+               // input) to the decoder in one go
+               int end = readPos + 1;
+               while (end < inputSize && input [end] != '\e' &&
+                      input [end] != '\x18' && input [end] != '\x1a')
+                  ++end;
+               sixelDecoder.feed (input + readPos, end - readPos);
+               readPos = end - 1;
+               break;
+            }
+            }
+            break;
+         case InputState::DCS_Sixel_Esc:
+            handle_Sixel ();
+            if (ch != '\\')
+            {
+               // Any other ESC sequence also ends the image; process
+               // the byte again as the start of that sequence
+               setState (compatLevel == CompatibilityLevel::VT52
+                         ? InputState::Escape_VT52
+                         : InputState::Escape);
+               inputOps [0] = 0;
+               nInputOps = 1;
+               lastEscBegin = std::max (0, readPos - 1);
+               --readPos;
+            }
+            break;
          case InputState::OSC:
             switch (ch)
             {
@@ -1419,11 +1575,40 @@ namespace zutty
                break;
             }
             break;
+         case InputState::APC:
+            switch (ch)
+            {
+            case '\e': setState (InputState::APC_Esc); break;
+            default:
+               // Kitty graphics chunks are at most 4096 bytes of payload
+               if (argBuf.size () < maxApcLength)
+                  argBuf.push_back (ch);
+               else
+               {
+                  logE << "APC argument string overflow" << std::endl;
+                  setState (InputState::Normal);
+               }
+               break;
+            }
+            break;
+         case InputState::APC_Esc:
+            switch (ch)
+            {
+            case '\\': handle_APC (); break;
+            default:
+               argBuf.push_back ('\e');
+               argBuf.push_back (ch);
+               setState (InputState::APC);
+               break;
+            }
+            break;
          }
       }
       traceNormalInput ();
       showCursor ();
       redraw ();
+      curInput = nullptr;
+      PROBE1 (input_end, inputSize);
    }
 
    void
@@ -1504,6 +1689,7 @@ namespace zutty
       Point pt (pX / glyphPx, pY / glyphPy);
 
       Rect& selection = cf->getSelection ();
+      const Rect prevSelection = selection;
 
       if (selection.rectangular)
       {
@@ -1570,7 +1756,10 @@ namespace zutty
             selection.br = pt;
          }
       }
-      redraw ();
+
+      // Most pointer motion stays within the same cell
+      if (selection != prevSelection)
+         redraw ();
    }
 
    bool
@@ -1618,4 +1807,230 @@ namespace zutty
          writePty (oss.str ().c_str (), true);
    }
 
+   void
+   Vterm::dcs_SixelBegin ()
+   {
+      // P2 = 1: pixels not set by the image remain transparent
+      uint32_t p2 = 0;
+      const auto arg = std::string ((char*)argBuf.data (), argBuf.size ());
+      const size_t semi = arg.find (';');
+      if (semi != std::string::npos)
+         p2 = strtoul (arg.c_str () + semi + 1, nullptr, 10);
+
+      sixelDecoder.begin (p2 == 1, *bg);
+      setState (InputState::DCS_Sixel);
+   }
+
+   // Sixel images are placed at the cursor, left at the last image row
+   void
+   Vterm::handle_Sixel ()
+   {
+      TRACE_FUN;
+      ImagePtr image = sixelDecoder.finish ();
+      if (image)
+      {
+         ImagePlacement p;
+         p.image = image;
+         p.cols = std::min ((image->width + glyphPx - 1) / glyphPx,
+                            65535 / glyphPx);
+         p.rows = std::min ((image->height + glyphPy - 1) / glyphPy,
+                            65535 / glyphPy);
+         p.width = image->width;
+         p.height = image->height;
+         p.src = Rect (0, 0, image->width, image->height);
+         placeImageAtCursor (p);
+      }
+      setState (InputState::Normal);
+   }
+
+   // Place p at the cursor and move the cursor down to its last row
+   void
+   Vterm::placeImageAtCursor (ImagePlacement& p)
+   {
+      normalizeCursorPos ();
+      p.row = posY;
+      p.col = posX;
+      cf->placeImage (p);
+
+      for (uint32_t k = 1; k < p.rows; ++k)
+         esc_IND ();
+   }
+
+   // Kitty graphics protocol, see image.h
+   void
+   Vterm::apc_KittyGraphics (const std::string& arg)
+   {
+      KittyCommand cmd;
+      if (kittyChunked)
+      {
+         // Continuation chunks only carry m= and more payload
+         KittyCommand chunk;
+         if (!chunk.parse (arg) ||
+             kittyChunkCmd.payload.size () + chunk.payload.size () >
+             maxKittyPayload)
+         {
+            kittyChunked = false;
+            kittyChunkCmd.payload.clear ();
+            kittyReply (kittyChunkCmd, "EFBIG:transmission too large");
+            return;
+         }
+         kittyChunkCmd.payload += chunk.payload;
+         if (chunk.more)
+            return;
+         kittyChunked = false;
+         cmd = std::move (kittyChunkCmd);
+         kittyChunkCmd = KittyCommand ();
+      }
+      else if (!cmd.parse (arg))
+      {
+         logT << "Kitty graphics: malformed command '" << arg << "'"
+              << std::endl;
+         return;
+      }
+      else if (cmd.more)
+      {
+         kittyChunked = true;
+         kittyChunkCmd = std::move (cmd);
+         return;
+      }
+
+      std::string error;
+      switch (cmd.action)
+      {
+      case 't': case 'T': case 'q':
+      {
+         ImagePtr image = loadKittyImage (cmd, error);
+         if (image && cmd.action != 'q')
+         {
+            imageStore.put (image);
+            if (cmd.action == 'T')
+               kittyPlace (cmd, image, error);
+         }
+         break;
+      }
+      case 'p':
+      {
+         ImagePtr image = imageStore.get (cmd.imageId);
+         if (image)
+            kittyPlace (cmd, image, error);
+         else
+            error = "ENOENT:no such image";
+         break;
+      }
+      case 'd':
+         kittyDelete (cmd);
+         return; // deletions are not acknowledged
+      default:
+         error = "EINVAL:unsupported action";
+         break;
+      }
+      kittyReply (cmd, error);
+   }
+
+   /* Place the image at the cursor, occupying as many cells as specified,
+    * or as needed to show the (source rectangle of the) image unscaled.
+    * Then, unless asked not to, move the cursor past the image, scrolling
+    * if needed, as if it was text.
+    */
+   void
+   Vterm::kittyPlace (const KittyCommand& cmd, const ImagePtr& image,
+                      std::string& error)
+   {
+      const uint32_t srcX = std::min (cmd.srcX, (uint32_t)image->width);
+      const uint32_t srcY = std::min (cmd.srcY, (uint32_t)image->height);
+      const uint32_t srcW = std::min (cmd.srcW ? cmd.srcW : image->width,
+                                      image->width - srcX);
+      const uint32_t srcH = std::min (cmd.srcH ? cmd.srcH : image->height,
+                                      image->height - srcY);
+      if (srcW == 0 || srcH == 0)
+      {
+         error = "EINVAL:empty source rectangle";
+         return;
+      }
+
+      uint32_t cols = cmd.cols;
+      uint32_t rows = cmd.rows;
+      if (cols && !rows) // keep the aspect ratio
+         rows = (cols * glyphPx * srcH + srcW * glyphPy - 1) / (srcW * glyphPy);
+      else if (rows && !cols)
+         cols = (rows * glyphPy * srcW + srcH * glyphPx - 1) / (srcH * glyphPx);
+      const bool scaled = cols || rows;
+      if (!scaled)
+      {
+         cols = (srcW + glyphPx - 1) / glyphPx;
+         rows = (srcH + glyphPy - 1) / glyphPy;
+      }
+      cols = std::max (1u, std::min (cols, 65535u / glyphPx));
+      rows = std::max (1u, std::min (rows, 65535u / glyphPy));
+
+      ImagePlacement p;
+      p.image = image;
+      p.placementId = cmd.placementId;
+      p.cols = cols;
+      p.rows = rows;
+      p.width = scaled ? cols * glyphPx : srcW;
+      p.height = scaled ? rows * glyphPy : srcH;
+      p.src = Rect (srcX, srcY, srcX + srcW, srcY + srcH);
+
+      if (cmd.noCursorMove)
+      {
+         normalizeCursorPos ();
+         p.row = posY;
+         p.col = posX;
+         cf->placeImage (p);
+         return;
+      }
+      placeImageAtCursor (p);
+      posX = std::min (p.col + cols, nCols - 1u);
+   }
+
+   void
+   Vterm::kittyDelete (const KittyCommand& cmd)
+   {
+      switch (cmd.deleteWhat)
+      {
+      case 'a':
+         cf->deleteImages ();
+         break;
+      case 'A':
+         cf->deleteImages ();
+         imageStore.clear ();
+         break;
+      case 'i':
+         if (cmd.imageId)
+            cf->deleteImages (cmd.imageId, cmd.placementId);
+         break;
+      case 'I':
+         if (cmd.imageId)
+         {
+            cf->deleteImages (cmd.imageId, cmd.placementId);
+            if (!cmd.placementId)
+               imageStore.remove (cmd.imageId);
+         }
+         break;
+      default:
+         logT << "Kitty graphics: unsupported deletion d=" << cmd.deleteWhat
+              << std::endl;
+         break;
+      }
+   }
+
+   void
+   Vterm::kittyReply (const KittyCommand& cmd, const std::string& error)
+   {
+      if (!error.empty ())
+         logT << "Kitty graphics: " << error << std::endl;
+
+      // Only commands with an image id get a reply, unless silenced
+      if (!cmd.imageId || cmd.quiet >= 2 || (error.empty () && cmd.quiet))
+         return;
+
+      std::ostringstream oss;
+      oss << "\e_Gi=" << cmd.imageId;
+      if (cmd.placementId)
+         oss << ",p=" << cmd.placementId;
+      oss << ";" << (error.empty () ? "OK" : error) << "\e\\";
+      writePty (oss.str ().c_str ());
+   }
+
 } // namespace zutty
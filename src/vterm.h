@@ -12,8 +12,14 @@
 #pragma once
 
 #include "frame.h"
+#include "hud.h"
+#include "image.h"
+#include "log.h"
+#include "sixel.h"
 #include "utf8.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -95,7 +101,17 @@ namespace zutty
 
       void resize (uint16_t winPx, uint16_t winPy);
 
-      void redraw ();
+      /* Run deferred actions that have become due: the debounced pty
+       * resize, the timeout of synchronized output mode and the summary of
+       * unhandled input. Call this from the event loop; returns the time in
+       * ms until the next one is due, or -1 if nothing is pending (suitable
+       * as a poll timeout).
+       */
+      int runTimers ();
+
+      // Unless forced, a no-op while invisible or in synchronized output
+      void redraw (bool force = false);
+      void expose (); // redraw and present the whole window
 
       // mapping of a certain VtKey to a sequence of input characters
       struct InputSpec
@@ -121,6 +137,7 @@ namespace zutty
       const MouseTrackingState& getMouseTrackingState () const;
 
       void setHasFocus (bool);
+      void setVisible (bool);
       void mouseWheelUp ();
       void mouseWheelDown ();
       void pageUp ();
@@ -141,6 +158,14 @@ namespace zutty
       void processInput (const unsigned char *const input, int size);
       void processInput (const std::string& str);
 
+      /* The pty is resized (and the program in it gets a SIGWINCH) only
+       * after the window geometry has been stable for a short while, so
+       * that an interactive resize does not make full-screen programs
+       * redraw for every intermediate size.
+       */
+      int flushPtyResize ();
+      int checkSyncOutputTimeout ();
+
       int writePty (const uint8_t* ucstr, size_t len, bool userInput = false);
 
       // table entry for deciding which set of InputSpecs to use
@@ -176,6 +201,7 @@ namespace zutty
          SelectCharset,
          CSI,
          CSI_priv,
+         CSI_priv_Dollar,
          CSI_Quote,
          CSI_DblQuote,
          CSI_Bang,
@@ -183,8 +209,12 @@ namespace zutty
          CSI_GT,
          DCS,
          DCS_Esc,
+         DCS_Sixel,
+         DCS_Sixel_Esc,
          OSC,
          OSC_Esc,
+         APC,
+         APC_Esc,
          VT52_CUP_Arg1,
          VT52_CUP_Arg2
       };
@@ -202,6 +232,7 @@ namespace zutty
          "SelectCharset",
          "CSI",
          "CSI_priv",
+         "CSI_priv_Dollar",
          "CSI_Quote",
          "CSI_DblQuote",
          "CSI_Bang",
@@ -209,8 +240,12 @@ namespace zutty
          "CSI_GT",
          "DCS",
          "DCS_Esc",
+         "DCS_Sixel",
+         "DCS_Sixel_Esc",
          "OSC",
          "OSC_Esc",
+         "APC",
+         "APC_Esc",
          "VT52_CUP_Arg1",
          "VT52_CUP_Arg2"
          };
@@ -233,6 +268,8 @@ namespace zutty
       void hideCursor ();
       void inputGraphicChar (unsigned char ch);
       void placeGraphicChar ();
+      int makeGraphicCell (CharVdev::Cell& c);
+      void putGraphicCells (const CharVdev::Cell& c, int w, uint16_t n);
       void jumpToNextTabStop ();
       void setFgFromPalIx ();
       void setBgFromPalIx ();
@@ -293,6 +330,7 @@ namespace zutty
       void csi_RM ();        // Reset Mode
       void csi_privSM ();    // Set Mode (private)
       void csi_privRM ();    // Reset Mode (private)
+      void csi_privDECRQM ();// Request Mode (private)
       void csi_SGR ();       // Select Graphic Rendition
 
       void csi_ecma48_SL (); // Shift Left
@@ -304,6 +342,8 @@ namespace zutty
       void esch_DECALN ();   // DEC Alignment Pattern Generator
       void handle_DCS ();    // Device Control String
       void handle_OSC ();    // Operating System Command
+      void handle_APC ();    // Application Program Command
+      void handle_Sixel ();  // Sixel graphics (DCS P1;P2;P3 q ... ST)
       void csiq_DECSCL ();   // DEC Set Compatibility Level
       void csi_XTWINOPS ();  // Xterm window operations
       void csi_XTMODKEYS (); // Xterm key modifier options
@@ -313,6 +353,14 @@ namespace zutty
       void osc_PaletteQuery (int, const std::string&);
       void osc_DynamicColorQuery (int, const std::string&);
 
+      void dcs_SixelBegin ();
+      void placeImageAtCursor (ImagePlacement& p);
+      void apc_KittyGraphics (const std::string&);
+      void kittyPlace (const KittyCommand& cmd, const ImagePtr& image,
+                       std::string& error);
+      void kittyDelete (const KittyCommand& cmd);
+      void kittyReply (const KittyCommand& cmd, const std::string& error);
+
       uint16_t winPx;
       uint16_t winPy;
       uint16_t nCols;
@@ -320,12 +368,28 @@ namespace zutty
       uint16_t glyphPx;
       uint16_t glyphPy;
       int ptyFd;
+      bool firstRead = true;
+      bool ptyResizePending = false;
+      std::chrono::steady_clock::time_point ptyResizeDue;
 
       RefreshHandlerFn onRefresh;
       OscHandlerFn onOsc;
       bool haveOscHandler = false;
       BellHandlerFn onBell;
 
+      // Keys of the counters below: the input state in the high 16 bits,
+      // the character (or OSC command, capped) in the low 16 bits
+      static uint32_t diagKey (InputState state, uint32_t code)
+      {
+         return (uint32_t)state << 16 | std::min (code, 0xffffu);
+      }
+
+      // Counted by input state and character (see DiagCounter)
+      DiagCounter unhandledInputDiag;
+      // DCS, APC (and OSC, if there is no handler) sequences not handled,
+      // counted by kind and first character (or OSC command)
+      DiagCounter unhandledSeqDiag;
+
       // Cell storage, display and input state
 
       Frame frame_pri;
@@ -349,8 +413,12 @@ namespace zutty
       int bgPalIx;
       bool reverseVideo = false;
       bool hasFocus = false;
+      bool visible = true; // if false, redraw () is a no-op
+      // while syncOutputMode is set, redraw () is a no-op until this time
+      std::chrono::steady_clock::time_point syncOutputDeadline;
 
       unsigned char inputBuf [32 * 1024];
+      const unsigned char* curInput = nullptr; // during processInput
       int readPos = 0;
       int lastEscBegin = 0;
       int lastNormalBegin = 0;
@@ -362,6 +430,10 @@ namespace zutty
       size_t nInputOps = 0;
       Utf8Decoder utf8dec;
       std::vector <unsigned char> argBuf;
+      ImageStore imageStore;
+      SixelDecoder sixelDecoder;
+      KittyCommand kittyChunkCmd; // first chunk of a chunked transmission
+      bool kittyChunked = false;
       unsigned char scsDst;  // Select charset / destination designator
       unsigned char scsMod;  // Select charset / selector (intermediate)
 
@@ -378,6 +450,7 @@ namespace zutty
       bool bkspSendsDel = true;
       bool localEcho = false;
       bool bracketedPasteMode = false;
+      bool syncOutputMode = false;
       bool altScrollMode = false;
       bool altSendsEscape = true;
       uint8_t modifyOtherKeys = 1;
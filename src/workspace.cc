@@ -0,0 +1,537 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#include "log.h"
+#include "options.h"
+#include "workspace.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace
+{
+   using namespace zutty;
+
+   // Window size (in pixels) that a Vterm with the given cells would have
+   uint16_t
+   pixelSize (int cells, uint16_t glyphSize)
+   {
+      return 2 * opts.border + std::max (0, cells) * glyphSize;
+   }
+
+   void
+   reportFocus (Vterm& vt, bool hasFocus)
+   {
+      if (vt.getMouseTrackingState ().focusEventMode)
+         vt.writePty (hasFocus ? "\e[I" : "\e[O");
+      vt.setHasFocus (hasFocus);
+   }
+
+} // namespace
+
+namespace zutty
+{
+   Workspace::Workspace (uint16_t glyphPx_, uint16_t glyphPy_,
+                         uint16_t winPx_, uint16_t winPy_, Renderer& renderer_,
+                         const SpawnFn& spawn_, const SetupFn& setup_,
+                         const FocusFn& onFocus_, const TitleFn& onTitle_)
+      : glyphPx {glyphPx_}
+      , glyphPy {glyphPy_}
+      , winPx {winPx_}
+      , winPy {winPy_}
+      , renderer (renderer_)
+      , spawn {spawn_}
+      , setup {setup_}
+      , onFocus {onFocus_}
+      , onTitle {onTitle_}
+   {
+      Tab tab;
+      tab.root = makePane (gridRect ());
+      tab.focused = tab.root.get ();
+      tabs.push_back (std::move (tab));
+
+      onFocus (getFocused ());
+      layout ();
+      updateTitle ();
+   }
+
+   Workspace::~Workspace ()
+   {
+      for (const auto& tab: tabs)
+      {
+         std::vector <Node*> panes;
+         collectPanes (tab.root.get (), panes);
+         for (Node* pane: panes)
+            close (pane->ptyFd);
+      }
+   }
+
+   Point
+   Workspace::getFocusedOrigin () const
+   {
+      const Rect& r = focused ()->rect;
+      return Point (r.tl.x * glyphPx, r.tl.y * glyphPy);
+   }
+
+   void
+   Workspace::resize (uint16_t winPx_, uint16_t winPy_)
+   {
+      winPx = winPx_;
+      winPy = winPy_;
+      layout ();
+   }
+
+   void
+   Workspace::setVisible (bool visible_)
+   {
+      visible = visible_;
+      for (Node* pane: activePanes ())
+         pane->vt->setVisible (visible);
+   }
+
+   void
+   Workspace::setHasFocus (bool hasFocus_)
+   {
+      hasFocus = hasFocus_;
+      reportFocus (*getFocused (), hasFocus);
+   }
+
+   void
+   Workspace::expose ()
+   {
+      for (Node* pane: activePanes ())
+         pane->vt->expose ();
+   }
+
+   void
+   Workspace::redraw ()
+   {
+      for (Node* pane: activePanes ())
+         pane->vt->redraw ();
+   }
+
+   void
+   Workspace::newTab ()
+   {
+      Node* from = focused ();
+      Tab tab;
+      tab.root = makePane (gridRect ());
+      tab.focused = tab.root.get ();
+      tabs.insert (tabs.begin () + activeTab + 1, std::move (tab));
+      ++activeTab;
+
+      switchFocus (from, focused ());
+      layout ();
+      updateTitle ();
+   }
+
+   void
+   Workspace::nextTab ()
+   {
+      showTab ((activeTab + 1) % tabs.size ());
+   }
+
+   void
+   Workspace::prevTab ()
+   {
+      showTab ((activeTab + tabs.size () - 1) % tabs.size ());
+   }
+
+   void
+   Workspace::split (bool sideBySide)
+   {
+      Node* pane = focused ();
+      const Rect r = pane->rect;
+      const int size = sideBySide ? r.br.x - r.tl.x : r.br.y - r.tl.y;
+      if (size < 3) // room for two panes and the separator
+      {
+         logI << "Pane too small to split" << std::endl;
+         return;
+      }
+
+      std::unique_ptr <Node>& slot = slotOf (pane);
+      auto node = std::make_unique <Node> ();
+      node->sideBySide = sideBySide;
+      node->parent = pane->parent;
+      node->first = std::move (slot);
+      node->first->parent = node.get ();
+      node->second = makePane (r); // resized by layout () below
+      node->second->parent = node.get ();
+      Node* newPane = node->second.get ();
+      slot = std::move (node);
+
+      tabs [activeTab].focused = newPane;
+      switchFocus (pane, newPane);
+      layout ();
+      updateTitle ();
+   }
+
+   void
+   Workspace::focusNext ()
+   {
+      const auto panes = activePanes ();
+      auto it = std::find (panes.begin (), panes.end (), focused ());
+      Node* to = ++it == panes.end () ? panes.front () : *it;
+
+      Node* from = focused ();
+      tabs [activeTab].focused = to;
+      switchFocus (from, to);
+      layout ();
+      updateTitle ();
+   }
+
+   void
+   Workspace::focusPrev ()
+   {
+      const auto panes = activePanes ();
+      auto it = std::find (panes.begin (), panes.end (), focused ());
+      Node* to = it == panes.begin () ? panes.back () : *--it;
+
+      Node* from = focused ();
+      tabs [activeTab].focused = to;
+      switchFocus (from, to);
+      layout ();
+      updateTitle ();
+   }
+
+   void
+   Workspace::focusAt (int pX, int pY)
+   {
+      const int x = (pX - opts.border) / glyphPx;
+      const int y = (pY - opts.border) / glyphPy;
+      for (Node* pane: activePanes ())
+      {
+         const Rect& r = pane->rect;
+         if (x >= r.tl.x && x < r.br.x && y >= r.tl.y && y < r.br.y)
+         {
+            if (pane == focused ())
+               return;
+
+            Node* from = focused ();
+            tabs [activeTab].focused = pane;
+            switchFocus (from, pane);
+            layout ();
+            updateTitle ();
+            return;
+         }
+      }
+   }
+
+   void
+   Workspace::setTitle (const Vterm& vt, const std::string& title)
+   {
+      for (const auto& tab: tabs)
+      {
+         std::vector <Node*> panes;
+         collectPanes (tab.root.get (), panes);
+         for (Node* pane: panes)
+            if (pane->vt.get () == &vt)
+            {
+               pane->title = title;
+               updateTitle ();
+               return;
+            }
+      }
+   }
+
+   void
+   Workspace::addPollFds (std::vector <struct pollfd>& pollset, bool holdIn)
+   {
+      polled.clear ();
+      for (const auto& tab: tabs)
+         collectPanes (tab.root.get (), polled);
+
+      for (Node* pane: polled)
+      {
+         const bool hold = holdIn && pane == focused ();
+         pollset.push_back ({hold ? -pane->ptyFd : pane->ptyFd, POLLIN, 0});
+      }
+   }
+
+   bool
+   Workspace::readPtys (const struct pollfd* pfds)
+   {
+      std::vector <Node*> exited;
+      for (size_t k = 0; k < polled.size (); ++k)
+         if ((pfds [k].revents & (POLLIN | POLLHUP)) &&
+             polled [k]->vt->readPty ())
+            exited.push_back (polled [k]);
+
+      for (Node* pane: exited)
+         closePane (pane);
+      if (!exited.empty ())
+         polled.clear ();
+
+      return !tabs.empty ();
+   }
+
+   int
+   Workspace::runTimers ()
+   {
+      int timeout = -1;
+      for (const auto& tab: tabs)
+      {
+         std::vector <Node*> panes;
+         collectPanes (tab.root.get (), panes);
+         for (Node* pane: panes)
+         {
+            const int t = pane->vt->runTimers ();
+            if (t >= 0 && (timeout < 0 || t < timeout))
+               timeout = t;
+         }
+      }
+      return timeout;
+   }
+
+   // private methods
+
+   void
+   Workspace::collectPanes (Node* node, std::vector <Node*>& panes)
+   {
+      if (node->vt)
+      {
+         panes.push_back (node);
+         return;
+      }
+      collectPanes (node->first.get (), panes);
+      collectPanes (node->second.get (), panes);
+   }
+
+   std::vector <Workspace::Node*>
+   Workspace::activePanes () const
+   {
+      std::vector <Node*> panes;
+      collectPanes (tabs [activeTab].root.get (), panes);
+      return panes;
+   }
+
+   std::unique_ptr <Workspace::Node>&
+   Workspace::slotOf (Node* node)
+   {
+      if (node->parent)
+         return node->parent->first.get () == node ? node->parent->first
+                                                   : node->parent->second;
+      for (auto& tab: tabs)
+         if (tab.root.get () == node)
+            return tab.root;
+      throw std::logic_error ("Workspace: node not found");
+   }
+
+   Rect
+   Workspace::gridRect () const
+   {
+      return Rect (0, 0,
+                   std::max (1, (winPx - 2 * opts.border) / glyphPx),
+                   std::max (1, (winPy - 2 * opts.border) / glyphPy));
+   }
+
+   std::unique_ptr <Workspace::Node>
+   Workspace::makePane (const Rect& rect)
+   {
+      const int nCols = std::max (1, rect.br.x - rect.tl.x);
+      const int nRows = std::max (1, rect.br.y - rect.tl.y);
+
+      auto pane = std::make_unique <Node> ();
+      pane->ptyFd = spawn (nCols, nRows);
+      pane->vt = std::make_unique <Vterm> (glyphPx, glyphPy,
+                                           pixelSize (nCols, glyphPx),
+                                           pixelSize (nRows, glyphPy),
+                                           pane->ptyFd);
+      pane->title = opts.title;
+      pane->rect = rect;
+
+      Node* node = pane.get ();
+      pane->vt->setRefreshHandler ([this, node] (const Frame& frame)
+                                   {
+                                      if (node->index >= 0)
+                                         renderer.update (frame, node->index);
+                                   });
+      setup (*pane->vt);
+      return pane;
+   }
+
+   void
+   Workspace::closePane (Node* pane)
+   {
+      const bool wasFocused = (pane == focused ());
+      Node* root = pane;
+      while (root->parent)
+         root = root->parent;
+      size_t tab = 0;
+      while (tabs [tab].root.get () != root)
+         ++tab;
+
+      close (pane->ptyFd);
+      if (!pane->parent)
+      {
+         tabs.erase (tabs.begin () + tab);
+         if (tabs.empty ())
+            return;
+         if (tab < activeTab || activeTab == tabs.size ())
+            --activeTab;
+      }
+      else
+      {
+         Node* parent = pane->parent;
+         auto& sibling = parent->first.get () == pane ? parent->second
+                                                      : parent->first;
+         Node* survivor = sibling.get ();
+         if (tabs [tab].focused == pane)
+         {
+            // Focus the pane nearest to the closed one
+            std::vector <Node*> panes;
+            collectPanes (survivor, panes);
+            tabs [tab].focused = parent->first.get () == pane
+                               ? panes.front () : panes.back ();
+         }
+         survivor->parent = parent->parent;
+         slotOf (parent) = std::move (sibling); // deletes parent and pane
+      }
+
+      if (wasFocused)
+         switchFocus (nullptr, focused ());
+      layout ();
+      updateTitle ();
+   }
+
+   void
+   Workspace::switchFocus (Node* from, Node* to)
+   {
+      if (from == to)
+         return;
+      if (hasFocus && from)
+         reportFocus (*from->vt, false);
+      if (hasFocus)
+         reportFocus (*to->vt, true);
+      onFocus (to->vt.get ());
+   }
+
+   void
+   Workspace::showTab (size_t tab)
+   {
+      if (tab == activeTab)
+         return;
+
+      Node* from = focused ();
+      activeTab = tab;
+      switchFocus (from, focused ());
+      layout ();
+      updateTitle ();
+   }
+
+   void
+   Workspace::layout ()
+   {
+      for (size_t t = 0; t < tabs.size (); ++t)
+      {
+         if (t == activeTab)
+            continue;
+         std::vector <Node*> panes;
+         collectPanes (tabs [t].root.get (), panes);
+         for (Node* pane: panes)
+         {
+            pane->index = -1;
+            pane->vt->setVisible (false);
+         }
+      }
+
+      std::vector <Rect> panes;
+      Node* root = tabs [activeTab].root.get ();
+      if (tabs.size () == 1 && root->vt)
+      {
+         // A single pane fills the window, with no layout at all
+         root->rect = gridRect ();
+         root->index = 0;
+         const bool relayout = !layoutPanes.empty ();
+         if (relayout)
+            renderer.setLayout (winPx, winPy, panes, 0);
+         layoutPanes.clear ();
+         layoutFocused = -1;
+
+         root->vt->resize (winPx, winPy);
+         root->vt->setVisible (visible);
+         if (relayout)
+            root->vt->expose ();
+         return;
+      }
+
+      layoutNode (root, gridRect (), panes);
+      const int focusedIndex = focused ()->index;
+      const bool relayout = winPx != layoutPx || winPy != layoutPy ||
+                            panes != layoutPanes ||
+                            focusedIndex != layoutFocused;
+      if (relayout)
+      {
+         renderer.setLayout (winPx, winPy, panes, focusedIndex);
+         layoutPx = winPx;
+         layoutPy = winPy;
+         layoutPanes = panes;
+         layoutFocused = focusedIndex;
+      }
+
+      // The Renderer waits for a frame of the right size from each pane
+      for (Node* pane: activePanes ())
+      {
+         const Rect& r = pane->rect;
+         pane->vt->resize (pixelSize (r.br.x - r.tl.x, glyphPx),
+                           pixelSize (r.br.y - r.tl.y, glyphPy));
+         pane->vt->setVisible (visible);
+         if (relayout)
+            pane->vt->expose ();
+      }
+   }
+
+   void
+   Workspace::layoutNode (Node* node, const Rect& rect,
+                          std::vector <Rect>& panes)
+   {
+      node->rect = rect;
+      if (node->vt)
+      {
+         node->index = panes.size ();
+         panes.push_back (rect);
+         return;
+      }
+
+      // The first child gets the larger half, the separator sits between
+      Rect r1 = rect;
+      Rect r2 = rect;
+      if (node->sideBySide)
+      {
+         r1.br.x = rect.tl.x + (rect.br.x - rect.tl.x) / 2;
+         r2.tl.x = std::min (rect.br.x, r1.br.x + 1);
+      }
+      else
+      {
+         r1.br.y = rect.tl.y + (rect.br.y - rect.tl.y) / 2;
+         r2.tl.y = std::min (rect.br.y, r1.br.y + 1);
+      }
+      layoutNode (node->first.get (), r1, panes);
+      layoutNode (node->second.get (), r2, panes);
+   }
+
+   void
+   Workspace::updateTitle ()
+   {
+      std::string title = focused ()->title;
+      if (tabs.size () > 1)
+         title = "[" + std::to_string (activeTab + 1) + "/" +
+                 std::to_string (tabs.size ()) + "] " + title;
+
+      if (title != windowTitle)
+      {
+         windowTitle = title;
+         onTitle (title);
+      }
+   }
+
+} // namespace zutty
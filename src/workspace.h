@@ -0,0 +1,156 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+#pragma once
+
+#include "base.h"
+#include "renderer.h"
+#include "vterm.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <vector>
+
+namespace zutty
+{
+   /* The terminals shown in one window: tabs, each split into panes by a
+    * tree of side-by-side and top/bottom splits, with a one-cell wide
+    * separator between the two sides. Each pane has its own Vterm and pty.
+    *
+    * Only the panes of the active tab are visible. They are laid out on
+    * the character grid of the window and drawn by the (single) Renderer,
+    * each Frame going to its own pane. With a single pane in total, there
+    * is no layout: its Vterm gets the real window size, as without tabs.
+    */
+   class Workspace
+   {
+   public:
+      // Start the program of a new pane; returns the master side of its pty
+      using SpawnFn = std::function <int (uint16_t nCols, uint16_t nRows)>;
+      // Install the OSC and bell handlers of a new Vterm
+      using SetupFn = std::function <void (Vterm&)>;
+      // Called with the focused Vterm whenever that changes
+      using FocusFn = std::function <void (Vterm*)>;
+      // Called with the window title whenever that changes
+      using TitleFn = std::function <void (const std::string&)>;
+
+      Workspace (uint16_t glyphPx, uint16_t glyphPy,
+                 uint16_t winPx, uint16_t winPy, Renderer& renderer,
+                 const SpawnFn& spawn, const SetupFn& setup,
+                 const FocusFn& onFocus, const TitleFn& onTitle);
+
+      ~Workspace ();
+
+      Vterm* getFocused () const { return focused ()->vt.get (); }
+
+      // Window pixel position corresponding to the top left corner of the
+      // focused pane if that were the whole window (so that subtracting
+      // it from pointer coordinates yields what its Vterm expects)
+      Point getFocusedOrigin () const;
+
+      void resize (uint16_t winPx, uint16_t winPy);
+      void setVisible (bool visible);
+      void setHasFocus (bool hasFocus);
+      void expose ();
+      void redraw ();
+
+      void newTab ();
+      void nextTab ();
+      void prevTab ();
+      void split (bool sideBySide);
+      void focusNext ();
+      void focusPrev ();
+      void focusAt (int pX, int pY); // pointer position in the window
+
+      // Set the title of the pane of vt (as requested by OSC 0 or 2)
+      void setTitle (const Vterm& vt, const std::string& title);
+
+      /* Append the pty of each pane (in all tabs) to pollset. If holdIn,
+       * the focused pane is not polled for input (with a negated fd).
+       */
+      void addPollFds (std::vector <struct pollfd>& pollset, bool holdIn);
+
+      /* Read the ptys with input, as polled by the pollset entries added
+       * by the last addPollFds (starting at pfds). Panes whose program
+       * has exited are closed. Returns false once there are none left.
+       */
+      bool readPtys (const struct pollfd* pfds);
+
+      // Run the timers of all terminals; returns the poll timeout
+      int runTimers ();
+
+   private:
+      struct Node
+      {
+         // Leaf: a pane
+         std::unique_ptr <Vterm> vt;
+         int ptyFd = -1;
+         std::string title;
+
+         // Split: two children, side by side or top and bottom
+         bool sideBySide = false;
+         std::unique_ptr <Node> first;
+         std::unique_ptr <Node> second;
+
+         Node* parent = nullptr;
+         Rect rect;       // in cells, bottom right exclusive
+         int index = -1;  // of the pane in the Renderer layout; -1: hidden
+      };
+
+      struct Tab
+      {
+         std::unique_ptr <Node> root;
+         Node* focused = nullptr;
+      };
+
+      const uint16_t glyphPx;
+      const uint16_t glyphPy;
+      uint16_t winPx;
+      uint16_t winPy;
+      Renderer& renderer;
+      const SpawnFn spawn;
+      const SetupFn setup;
+      const FocusFn onFocus;
+      const TitleFn onTitle;
+
+      std::vector <Tab> tabs;
+      size_t activeTab = 0;
+      bool visible = true;
+      bool hasFocus = false;
+      std::vector <Node*> polled; // panes in the order of addPollFds
+
+      // Last layout passed to the Renderer
+      uint16_t layoutPx = 0;
+      uint16_t layoutPy = 0;
+      std::vector <Rect> layoutPanes;
+      int layoutFocused = -1;
+      std::string windowTitle;
+
+      static void collectPanes (Node* node, std::vector <Node*>& panes);
+
+      Node* focused () const { return tabs [activeTab].focused; }
+      std::vector <Node*> activePanes () const;
+      std::unique_ptr <Node>& slotOf (Node* node);
+      Rect gridRect () const;
+      std::unique_ptr <Node> makePane (const Rect& rect);
+      void closePane (Node* pane);
+      void switchFocus (Node* from, Node* to);
+      void showTab (size_t tab);
+      void layout ();
+      void layoutNode (Node* node, const Rect& rect,
+                       std::vector <Rect>& panes);
+      void updateTitle ();
+   };
+
+} // namespace zutty
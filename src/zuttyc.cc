@@ -0,0 +1,99 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+/* zuttyc: ask a running Zutty server (zutty -server) to open a new window.
+ * All command line arguments are passed on to the new window, as if they
+ * had been given to zutty itself. The working directory and environment
+ * of the new window are taken from the client.
+ */
+
+#include "server.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <iostream>
+
+extern char** environ;
+
+int
+main (int argc, char* argv[])
+{
+   zutty::ServerRequest req;
+
+   char cwd [PATH_MAX];
+   if (getcwd (cwd, sizeof (cwd)) == nullptr)
+      strcpy (cwd, "/");
+   req.cwd = cwd;
+
+   for (int k = 1; k < argc; ++k)
+      req.args.push_back (argv [k]);
+
+   for (char** e = environ; *e; ++e)
+      req.env.push_back (*e);
+
+   const std::string path = zutty::getServerSocketPath ();
+   struct sockaddr_un addr {};
+   addr.sun_family = AF_UNIX;
+   strncpy (addr.sun_path, path.c_str (), sizeof (addr.sun_path) - 1);
+
+   int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0 || connect (fd, (struct sockaddr*) &addr, sizeof (addr)) < 0)
+   {
+      std::cerr << "zuttyc: can't connect to server at " << path << ": "
+                << strerror (errno) << "\n"
+                << "Start a server with: zutty -server" << std::endl;
+      return 1;
+   }
+
+   // Do not send our environment to a server run by someone else
+   if (!zutty::isPeerSameUser (fd))
+   {
+      std::cerr << "zuttyc: server at " << path
+                << " is run by another user, refusing to connect" << std::endl;
+      return 1;
+   }
+
+   const std::string msg = req.encode ();
+   size_t pos = 0;
+   while (pos < msg.size ())
+   {
+      ssize_t n = write (fd, msg.data () + pos, msg.size () - pos);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n < 0)
+      {
+         std::cerr << "zuttyc: write: " << strerror (errno) << std::endl;
+         return 1;
+      }
+      pos += n;
+   }
+   shutdown (fd, SHUT_WR);
+
+   std::string rsp;
+   char buf [256];
+   ssize_t n;
+   while ((n = read (fd, buf, sizeof (buf))) > 0 || (n < 0 && errno == EINTR))
+      if (n > 0)
+         rsp.append (buf, n);
+   close (fd);
+
+   if (rsp.empty () || rsp.compare (0, 6, "Error:") == 0)
+   {
+      std::cerr << "zuttyc: "
+                << (rsp.empty () ? "no response from server\n" : rsp);
+      return 1;
+   }
+   return 0;
+}
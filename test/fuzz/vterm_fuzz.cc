@@ -0,0 +1,138 @@
+/* This file is part of Zutty.
+ * Copyright (C) 2020 Tom Szilagyi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * See the file LICENSE for the full license.
+ */
+
+/* libFuzzer target feeding its input to a Vterm, as the output of a
+ * program running in the terminal (see -headless, minus the rendering).
+ *
+ * Besides crashes, it looks for inputs that are slow to process: the time
+ * spent per input byte is reported to libFuzzer as extra coverage, so that
+ * inputs reaching a higher order of magnitude of it are kept in the corpus
+ * and mutated further. An input taking more than timeBudget is reported
+ * as a failure. Build with: CXX=clang++ ./waf configure --fuzz --debug
+ * and run e.g.: build/src/vterm_fuzz -max_len=4096 CORPUS_DIR
+ */
+
+#include "options.h"
+#include "pty.h"
+#include "vterm.h"
+
+#include <chrono>
+#include <clocale>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace zutty;
+
+namespace
+{
+   using Clock = std::chrono::steady_clock;
+
+   constexpr const uint16_t glyphPx = 8;
+   constexpr const uint16_t glyphPy = 16;
+   constexpr const std::chrono::milliseconds timeBudget {1000};
+
+   // Buckets of log2 (nanoseconds per input byte)
+   __attribute__ ((used, section ("__libfuzzer_extra_counters")))
+   uint8_t slowness [32];
+
+   int masterFd = -1;
+   int slaveFd = -1;
+
+   // Discard the replies of the terminal
+   void
+   drainReplies ()
+   {
+      char buf [4096];
+      while (read (slaveFd, buf, sizeof (buf)) > 0)
+         ;
+   }
+}
+
+extern "C" int
+LLVMFuzzerInitialize (int* argc, char*** argv)
+{
+   const char* args [] = {"zutty", "-q", "-geometry", "80x24", nullptr};
+   int nArgs = 4;
+   opts.initialize (&nArgs, const_cast <char**> (args));
+   opts.parse ();
+   setlocale (LC_ALL, ""); // as per the environment, see main ()
+
+   pty_open (masterFd, slaveFd);
+   struct termios term;
+   if (tcgetattr (slaveFd, &term) == 0)
+   {
+      cfmakeraw (&term);
+      tcsetattr (slaveFd, TCSANOW, &term);
+   }
+   fcntl (slaveFd, F_SETFL, fcntl (slaveFd, F_GETFL) | O_NONBLOCK);
+   return 0;
+}
+
+extern "C" int
+LLVMFuzzerTestOneInput (const uint8_t* data, size_t size)
+{
+   const uint16_t winPx = 2 * opts.border + opts.nCols * glyphPx;
+   const uint16_t winPy = 2 * opts.border + opts.nRows * glyphPy;
+   Vterm vt (glyphPx, glyphPy, winPx, winPy, masterFd);
+   vt.resize (winPx, winPy);
+
+   // Let the terminal consume what is pending on the pty, waiting for at
+   // most timeoutMs for data to arrive (it is delivered asynchronously);
+   // only the time spent by the terminal is counted
+   Clock::duration elapsed {0};
+   auto pump = [&] (int timeoutMs)
+   {
+      struct pollfd pfd {masterFd, POLLIN, 0};
+      while (poll (&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN))
+      {
+         const auto start = Clock::now ();
+         vt.readPty ();
+         elapsed += Clock::now () - start;
+         timeoutMs = 0;
+      }
+      drainReplies ();
+   };
+
+   size_t pos = 0;
+   while (pos < size)
+   {
+      const ssize_t k = write (slaveFd, data + pos, size - pos);
+      if (k < 0 && errno != EAGAIN && errno != EINTR)
+         abort ();
+      if (k > 0)
+         pos += k;
+      pump (k > 0 ? 0 : 10);
+   }
+   pump (10);
+
+   const uint64_t ns = std::chrono::duration_cast
+      <std::chrono::nanoseconds> (elapsed).count ();
+   const uint64_t nsPerByte = ns / (size ? size : 1);
+   int bucket = 0;
+   while (bucket < 31 && (nsPerByte >> (bucket + 1)))
+      ++bucket;
+   slowness [bucket] = 1;
+
+   if (elapsed > timeBudget)
+   {
+      fprintf (stderr, "Input of %zu bytes took %llu ms (budget: %lld ms)\n",
+               size, (unsigned long long)(ns / 1000000),
+               (long long)timeBudget.count ());
+      abort ();
+   }
+   return 0;
+}
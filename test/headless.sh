@@ -0,0 +1,360 @@
+#!/usr/bin/env bash
+
+# Headless tests: terminal output is rendered offscreen by zutty -headless,
+# so no X server, window manager or input injection is needed, and the
+# whole test runs in well under a second.
+#
+# Each test writes terminal output to stdout; SYNC marks the point where
+# the screen is rendered and its signature checked against the reference.
+# References are specific to the font and the GL implementation: they were
+# recorded with DejaVu Sans Mono and Mesa llvmpipe. To use another setup,
+# pass a different font via ZUTTY_OPTS and replace references with - to
+# get the NEW signatures printed.
+
+cd $(dirname $0)
+
+RED="\\e[1;31m"
+GREEN="\\e[1;32m"
+YELLOW="\\e[1;33m"
+DFLT="\\e[0;39m"
+
+ZUTTY=${ZUTTY:-../build/src/zutty}
+ZUTTY_OPTS=${ZUTTY_OPTS:-"-geometry 80x24 -font DejaVuSansMono -q"}
+if [ ! -x "${ZUTTY}" ] ; then
+    printf "${RED}ERROR: Missing executable: ${ZUTTY}${DFLT}\n"
+    exit 1
+fi
+
+OUTPUT="$(pwd)/output/headless"
+mkdir -p ${OUTPUT}
+
+function SYNC {
+    printf "\e]120;%s\a" "$1"
+}
+
+function test_sgr {
+    printf "\e[H\e[J"
+    for attr in 0 1 3 4 7 ; do
+        printf "\e[${attr}mSGR ${attr}\e[0m\r\n"
+    done
+    for c in $(seq 30 37) $(seq 90 97) ; do
+        printf "\e[${c}m${c} "
+    done
+    printf "\e[0m\r\n"
+    SYNC sgr_01
+    printf "\e[2;5H\e[2K\e[7mreverse line\e[0m"
+    SYNC sgr_02
+}
+
+function test_truecolor {
+    printf "\e[H\e[J"
+    for i in $(seq 0 79) ; do
+        printf "\e[48;2;$((i * 3));$((255 - i * 3));128m "
+    done
+    printf "\e[0m\r\n"
+    SYNC truecolor_01
+}
+
+function test_vtscript {
+    zcat vtscript.gz
+    SYNC vtscript_01
+}
+
+function test_kitty {
+    printf "\e[H\e[J"
+    # 8x8 RGB checkerboard, scaled up to 4x2 cells
+    local rgb=""
+    for y in $(seq 0 7) ; do
+        for x in $(seq 0 7) ; do
+            if [ $(((x + y) % 2)) -eq 0 ] ; then
+                rgb="${rgb}\xff\x80\x00"
+            else
+                rgb="${rgb}\x00\x40\xff"
+            fi
+        done
+    done
+    printf "text before\r\n"
+    printf "\e_Ga=T,f=24,s=8,v=8,c=4,r=2;%s\e\\" \
+           "$(printf "${rgb}" | base64 -w0)"
+    printf "text after\r\n"
+    SYNC kitty_01
+    printf "\e_Ga=d\e\\"
+    SYNC kitty_02
+}
+
+function test_sixel {
+    printf "\e[H\e[J"
+    printf "text before\r\n"
+    # 24x12 pixels: red and blue halves, then a green stripe
+    printf '\eP0;0;0q"1;1;24;12'
+    printf '#1;2;100;0;0#2;2;0;0;100#3;2;0;100;0'
+    printf '#1!12~#2!12~-#3!24F\e\\'
+    printf "\r\ntext after\r\n"
+    SYNC sixel_01
+}
+
+# The following tests follow the vttest menus (cursor movements, screen
+# features, character sets, VT102 insert/delete, ECMA-48 extensions),
+# plus a few xterm extensions.
+
+function test_cursor {
+    # vttest 1: a frame of E's (DECALN, partially erased), within a
+    # border of * and + drawn with absolute and relative cursor movements
+    printf "\e[H\e[J\e#8\e[9;10H\e[1J\e[18;71H\e[0J"
+    for row in $(seq 9 18) ; do
+        printf "\e[${row};10H\e[1K\e[${row};71H\e[0K"
+    done
+    for row in $(seq 10 17) ; do
+        printf "\e[${row};12H\e[58X"
+    done
+    for col in $(seq 1 80) ; do
+        printf "\e[1;${col}H*\e[24;${col}f*"
+    done
+    printf "\e[2;2H"
+    for row in $(seq 2 23) ; do
+        printf "+\b\eD"
+    done
+    printf "\e[23;79H"
+    for row in $(seq 2 23) ; do
+        printf "+\b\eM"
+    done
+    for row in $(seq 2 23) ; do
+        printf "\e[${row}d\e[G*\e[80G*"
+    done
+    printf "\e[2;78H"
+    for col in $(seq 3 78) ; do
+        printf "+\e[2D"
+    done
+    printf "\e[23;3H"
+    for col in $(seq 3 78) ; do
+        printf "+\e[1D\e[1C"
+    done
+    printf "\e[1;1H\e[10A\e[24;80H\e[10B\e[80C\e[10D\e[100D"
+    printf "\e[12;15HThe screen should be cleared, and have an"
+    printf "\e[13;15Hunbroken border of *'s and +'s around the edge,"
+    printf "\e[14;15Hand exactly in the middle there should be a"
+    printf "\e[15;15Hframe of E's around this text."
+    SYNC cursor_01
+    # vttest 1: autowrap with cursor movements at the right margin
+    printf "\e[H\e[J\e[?7h"
+    local lower=abcdefghijklmnopqrstuvw upper=ABCDEFGHIJKLMNOPQRSTUVW
+    for i in $(seq 0 22) ; do
+        printf "\e[$((i + 1));80H${lower:i:1}${upper:i:1}"
+    done
+    printf "\e[?7l\e[24;75Habcdefghij\e[?7h"
+    SYNC cursor_02
+    # vttest 1: control characters embedded in sequences
+    printf "\e[H\e[J\e[?7h"
+    printf "A\e[2\bCB\e[<2\bC"
+    printf "\e[3;1HC\e[\x0b2DD\r\n"
+    printf "\e[\r5;10HE\e[6;10\x0bHF"
+    printf "\e[8;1HLeading zeros: \e[00000000009;000000017HG"
+    SYNC cursor_03
+}
+
+function test_screen {
+    # vttest 2: wrap around with autowrap on and off
+    printf "\e[H\e[J\e[?7h"
+    for i in $(seq 1 170) ; do printf "*" ; done
+    printf "\e[?7l\e[4;1H"
+    for i in $(seq 1 170) ; do printf "+" ; done
+    printf "\e[?7h"
+    SYNC screen_01
+    # vttest 2: tab stops, default, set, cleared and moved across
+    printf "\ec\e[H\e[J"
+    for i in $(seq 1 9) ; do printf "\t%d" ${i} ; done
+    printf "\e[3;1H\e[3g"
+    for col in $(seq 1 79) ; do
+        [ $((col % 3)) -eq 1 ] && printf "\eH"
+        printf "\e[C"
+    done
+    printf "\e[3;1H"
+    for i in $(seq 1 26) ; do printf "\t*" ; done
+    printf "\e[4;7H\e[g\e[4;40H\e[0g\e[4;1H"
+    for i in $(seq 1 24) ; do printf "\t+" ; done
+    printf "\e[6;1H\e[3I=\e[Z\e[Z#\e[2Z<\e[79G\t>"
+    SYNC screen_02
+    # vttest 2: scrolling region, soft scroll replaced by jump scroll
+    printf "\e[H\e[J\e[12;13r\e[12;1H"
+    for i in $(seq 1 20) ; do printf "line %d\r\n" ${i} ; done
+    printf "\e[1;24r\e[1;1H"
+    for i in $(seq 1 10) ; do printf "top %d\r\n" ${i} ; done
+    printf "\e[20;1HRI inside region:\e[5;10r\e[5;1H"
+    for i in $(seq 1 3) ; do printf "\eMri %d" ${i} ; done
+    printf "\e[r"
+    SYNC screen_03
+    # vttest 2: origin mode, cursor save/restore
+    printf "\e[H\e[J\e[?6h\e[23;24r\e[?6h"
+    printf "\e[2;1HOrigin mode: bottom line"
+    printf "\e[1;1HOrigin mode: second to last\e[?6l\e[r"
+    printf "\e[?6h\e[5;20r\e[1;1Hat top of region\e[100;100H<"
+    printf "\e[r\e[?6l\e[10;10H\e7\e[20;20H\e[1mbold\e8plain"
+    printf "\e[11;10H\e[s\e[1;70H\e[u\e[4munder\e[24m"
+    SYNC screen_04
+    # vttest 2: graphic rendition
+    printf "\e[H\e[J\e[1;24r"
+    printf "\e[1;20HGraphic rendition test pattern:"
+    printf "\e[4;1H\e[0mvanilla\e[4;40H\e[0;1mbold"
+    printf "\e[6;6H\e[;4munderline\e[6;45H\e[;1m\e[4mbold underline"
+    printf "\e[8;1H\e[0;5mblink\e[8;40H\e[0;5;1mbold blink"
+    printf "\e[10;6H\e[0;4;5munderline blink"
+    printf "\e[10;45H\e[0;1;4;5mbold underline blink"
+    printf "\e[12;1H\e[1;4;5;0;7mnegative\e[12;40H\e[0;1;7mbold negative"
+    printf "\e[14;6H\e[0;4;7munderline negative"
+    printf "\e[14;45H\e[0;1;4;7mbold underline negative"
+    printf "\e[16;1H\e[1;4;;5;7mblink negative"
+    printf "\e[16;40H\e[0;1;5;7mbold blink negative\e[0m"
+    SYNC screen_05
+}
+
+function test_charsets {
+    # vttest 3: US ASCII, UK and DEC special graphics in G0 and G1
+    printf "\e[H\e[J"
+    local chars=""
+    for c in $(seq 95 126) ; do
+        chars="${chars}\\x$(printf %x ${c})"
+    done
+    printf "\e(B%s: \e(B${chars}\r\n" "US ASCII   "
+    printf "\e(B%s: \e(A#${chars}\e(B\r\n" "UK         "
+    printf "\e(B%s: \e(0${chars}\e(B\r\n" "DEC special"
+    printf "\e)0%s: \x0e${chars}\x0f\r\n" "G1 with SO "
+    printf "\e(0lqqqwqqqk\r\nx   x   x\r\ntqqqnqqqu\r\nx   x   x\r\n"
+    printf "mqqqvqqqj\e(B\r\n"
+    printf "\e(0\e[10;1H"
+    for c in $(seq 96 126) ; do
+        printf "\e(0\\x$(printf %x ${c})\e(B%02x " ${c}
+        [ $(((c - 95) % 8)) -eq 0 ] && printf "\r\n"
+    done
+    printf "\e(B"
+    SYNC charsets_01
+}
+
+function test_insdel {
+    # vttest 8: insert/delete line and character, insert mode
+    printf "\e[H\e[J\e#8\e[2;23r"
+    printf "\e[1;1HTop line, not scrolled"
+    for i in $(seq 2 12) ; do printf "\e[2;1H\e[L" ; done
+    printf "\e[24;1H\e[20;1H\e[2M\e[r"
+    SYNC insdel_01
+    printf "\e[H\e[J"
+    for row in $(seq 1 12) ; do
+        printf "\e[${row};1H"
+        for i in $(seq 1 8) ; do printf "abcdefghij" ; done
+    done
+    printf "\e[1;10H\e[5@\e[2;10H\e[5P\e[3;10H\e[5X"
+    printf "\e[4;40H\e[4h12345\e[4l\e[5;40H\e[100@<"
+    printf "\e[6;40H\e[100P>\e[7;79H\e[4hxyz\e[4l"
+    printf "\e[8;30H\e[1K\e[9;30H\e[K\e[10;30H\e[2K"
+    printf "\e[11;1H\e[3M\e[1;1H\e[2L"
+    SYNC insdel_02
+    printf "\e[H\e[J\e#8\e[12;40H\e[1J"
+    SYNC insdel_03
+    printf "\e#8\e[12;40H\e[0J"
+    SYNC insdel_04
+}
+
+function test_colors {
+    # vttest 11: ISO 6429 colors, 256 colors and more renditions
+    printf "\e[H\e[J"
+    for bg in $(seq 40 47) ; do
+        for fg in $(seq 30 37) ; do
+            printf "\e[${fg};${bg}m %d/%d " $((fg - 30)) $((bg - 40))
+        done
+        printf "\e[0m\r\n"
+    done
+    for bg in $(seq 100 107) ; do
+        printf "\e[${bg};30m bright \e[0m"
+    done
+    printf "\r\n"
+    for c in $(seq 0 255) ; do
+        printf "\e[48;5;${c}m "
+        [ $((c % 64)) -eq 63 ] && printf "\e[0m\r\n"
+    done
+    printf "\e[3mitalic\e[23m \e[1mbold\e[22m \e[4;7munder reverse"
+    printf "\e[24;27m \e[38;5;208;48;5;17m256 colors\e[39;49m "
+    printf "\e[1;38;2;255;0;0mbold truecolor\e[10m off\e[0m"
+    printf "\r\n\e[44m\e[Kbackground color erase\e[0m"
+    SYNC colors_01
+}
+
+function test_wide {
+    # Double width characters, wrapping and overwriting halves
+    printf "\e[H\e[J"
+    printf "\xe4\xb8\x96\xe7\x95\x8c wide \xef\xbc\xa1\xef\xbc\xa2\r\n"
+    printf "\e[2;79H\xe4\xb8\x96\xe7\x95\x8c"
+    printf "\e[4;1H\xe4\xb8\x96\xe7\x95\x8c\xe4\xb8\x96\e[4;2Hx\e[4;3Hy"
+    printf "\e[5;1H\xe4\xb8\x96\xe7\x95\x8c\e[5;1H\e[1@"
+    printf "\e[6;1H\xe4\xb8\x96\xe7\x95\x8c\e[6;2H\e[1P"
+    printf "\e[7;1He\xcc\x81 combining, \xe2\x94\x80\xe2\x94\x80 box"
+    SYNC wide_01
+}
+
+function test_hmargins {
+    # DECLRMM: left/right margins confine wrapping and scrolling
+    printf "\e[H\e[J\e#8\e[?69h\e[20;60s\e[5;15r\e[5;20H"
+    for i in $(seq 1 20) ; do printf "margins %02d " ${i} ; done
+    printf "\e[10;30H\e[3@\e[11;30H\e[3P\e[12;20H\e[2L"
+    printf "\e[1;1H\e[?69l\e[r\e[20;1Houtside"
+    SYNC hmargins_01
+}
+
+function test_altscreen {
+    printf "\e[H\e[Jmain screen\r\n"
+    printf "\e[?1049h\e[H\e[Jalternate screen"
+    SYNC altscreen_01
+    printf "\e[?1049l"
+    SYNC altscreen_02
+}
+
+# test name, followed by <sync point> <reference signature> pairs
+TESTS=(
+    "sgr sgr_01 50de77edb7245c06 sgr_02 e322995c15459f4a"
+    "truecolor truecolor_01 5aa56a3929105865"
+    "vtscript vtscript_01 de88bbbfbc87c02f"
+    "kitty kitty_01 f1b9493941de3878 kitty_02 7c24492b98bab93c"
+    "sixel sixel_01 5563bc076af4c834"
+    "cursor cursor_01 d12aea430b49d7d8 cursor_02 969aa0e995d44296
+            cursor_03 8bc06968345d2c93"
+    "screen screen_01 ea2749564b382765 screen_02 83da03ffb99df212
+            screen_03 4306c9858f0252d5 screen_04 94d6d393a5785e36
+            screen_05 fcbb3c7829b02302"
+    "charsets charsets_01 180269cad96948ea"
+    "insdel insdel_01 5146beb16bd4b1ba insdel_02 59a5b554116cb314
+            insdel_03 84ffee332b8a9455 insdel_04 632049d670a5895e"
+    "colors colors_01 7886b0bf13746ebd"
+    "wide wide_01 edf64551a4832ccb"
+    "hmargins hmargins_01 755010bcfe6fce39"
+    "altscreen altscreen_01 c82304676b4cec44 altscreen_02 def19d4b1c1960b1"
+)
+
+EXIT_CODE=0
+for spec in "${TESTS[@]}" ; do
+    set -- ${spec}
+    name=$1; shift
+    test_${name} > ${OUTPUT}/${name}.in
+    LC_ALL=C.UTF-8 ${ZUTTY} ${ZUTTY_OPTS} -headless ${OUTPUT}/${name}.in \
+             > ${OUTPUT}/${name}.out 2> ${OUTPUT}/${name}.log
+    if [ $? -ne 0 ] ; then
+        printf "${name}: ${RED}FAIL${DFLT} (see ${OUTPUT}/${name}.log)\n"
+        EXIT_CODE=1
+        continue
+    fi
+    while [ $# -gt 0 ] ; do
+        snap=$1; refsig=$2; shift 2
+        sig=$(grep "^${snap} " ${OUTPUT}/${name}.out | awk '{print $2}')
+        if [ -z "${sig}" ] ; then
+            printf "${snap}: ${RED}FAIL${DFLT} (no such sync point)\n"
+            EXIT_CODE=1
+        elif [ "${refsig}" == "-" ] ; then
+            printf "${snap}: ${YELLOW}NEW${DFLT} ${sig}\n"
+            EXIT_CODE=1
+        elif [ "${sig}" == "${refsig}" ] ; then
+            printf "${snap}: ${GREEN}OK${DFLT}\n"
+        else
+            printf "${snap}: ${RED}FAIL${DFLT} sig ${sig} ref ${refsig}\n"
+            EXIT_CODE=1
+        fi
+    done
+done
+
+exit ${EXIT_CODE}
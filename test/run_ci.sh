@@ -2,7 +2,12 @@
 
 cd $(dirname $0)
 
+# Options of zutty -headless, shared by headless.sh and worstcase.sh
+export ZUTTY_OPTS=${ZUTTY_OPTS:-"-geometry 80x24 -font DejaVuSansMono -q"}
+
 echo "Running all automated tests with --ci-mode $@ ..." && \
+    ./headless.sh && \
+    ./worstcase.sh && \
     ./keys.sh --ci-mode $@ && \
     ./nonascii.sh --ci-mode $@ && \
     ./scrollback.sh --ci-mode $@ && \
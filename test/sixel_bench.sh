@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+
+# Sixel decoding throughput: a large sixel image is rendered by
+# zutty -headless, and the time taken is reported in MB/s of sixel input.
+# Includes terminal startup, so use a large enough SIZE (in MB).
+
+cd $(dirname $0)
+
+ZUTTY=${ZUTTY:-../build/src/zutty}
+ZUTTY_OPTS=${ZUTTY_OPTS:-"-geometry 80x24 -font DejaVuSansMono -q"}
+SIZE=${SIZE:-64}
+OUTPUT="$(pwd)/output/headless"
+mkdir -p ${OUTPUT}
+INPUT=${OUTPUT}/sixel_bench.in
+
+# A sequence of 1000x1000 images, each of 167 bands of varying colors and
+# repeat counts, similar to the output of img2sixel on photographic content
+awk -v size=${SIZE} 'BEGIN {
+    n = 0;
+    while (n < size * 1024 * 1024) {
+        printf "\033P0;1;0q\"1;1;1000;1000";
+        for (c = 0; c < 256; ++c)
+            printf "#%d;2;%d;%d;%d", c, c % 101, (c * 7) % 101, (c * 13) % 101;
+        for (band = 0; band < 167; ++band) {
+            line = "";
+            for (c = 0; c < 16; ++c) {
+                line = line sprintf ("#%d", (band + c * 17) % 256);
+                for (x = 0; x < 50; ++x)
+                    line = line sprintf ("%c", 63 + (x * 7 + c) % 64);
+                line = line "!10~$";
+            }
+            line = line "-";
+            printf "%s", line;
+            n += length (line);
+        }
+        printf "\033\\";
+    }
+}' > ${INPUT}
+BYTES=$(stat -c%s ${INPUT})
+
+START=$(date +%s.%N)
+${ZUTTY} ${ZUTTY_OPTS} -headless ${INPUT} > /dev/null || exit 1
+END=$(date +%s.%N)
+
+awk -v b=${BYTES} -v t0=${START} -v t1=${END} 'BEGIN {
+    printf "%d bytes of sixel data in %.2f s: %.1f MB/s\n",
+           b, t1 - t0, b / 1048576 / (t1 - t0);
+}'
@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+
+# Worst-case inputs: escape sequences with a high cost per input byte
+# (each of them repeated to make up SIZE kB) are rendered by zutty
+# -headless, which must process each input within BUDGET seconds, and
+# must not crash. The inputs are kept in output/worstcase and make up a
+# good seed corpus for test/fuzz/vterm_fuzz (see HACKING.org).
+
+cd $(dirname $0)
+
+RED="\\e[1;31m"
+GREEN="\\e[1;32m"
+DFLT="\\e[0;39m"
+
+ZUTTY=${ZUTTY:-../build/src/zutty}
+ZUTTY_OPTS=${ZUTTY_OPTS:-"-geometry 80x24 -font DejaVuSansMono -q"}
+SIZE=${SIZE:-256}
+BUDGET=${BUDGET:-3}
+if [ ! -x "${ZUTTY}" ] ; then
+    printf "${RED}ERROR: Missing executable: ${ZUTTY}${DFLT}\n"
+    exit 1
+fi
+
+OUTPUT="$(pwd)/output/worstcase"
+mkdir -p ${OUTPUT}
+
+# Repeat the sequence (given in printf format) to make up SIZE kB
+function repeat {
+    local seq=$(printf "$1"; printf x)
+    awk -v size=${SIZE} -v seq="${seq%x}" 'BEGIN {
+        for (n = 0; n < size * 1024; n += length (seq))
+            printf "%s", seq;
+    }'
+}
+
+# test name, followed by the sequence repeated
+TESTS=(
+    "rep x\e[65535b"
+    "rep_max x\e[4294967295b"
+    "rep_dw 一\e[65535b"
+    "rep_insert \e[4hx\e[65535b"
+    "decstbm \e[r\e[24H\n\e[2;20r"
+    "ildl \e[2;23r\e[5H\e[999L\e[999M"
+    "su_sd \e[2;20rx\e[999S\e[999T"
+    "ich_dch \e[1;1H\e[999@\e[999P"
+    "hscroll \e[?69h\e[2;70s\e[5;5H\e[999@"
+    "insert \e[4hxxxxxxxxxxxxxxxx"
+    "scroll \n\n\n\n\n\n\n\n"
+    "decaln \e#8"
+    "deccolm \e[?40h\e[?3h\e[?3l"
+    "ed \e[2J"
+)
+
+EXIT_CODE=0
+for spec in "${TESTS[@]}" ; do
+    name=${spec%% *}
+    repeat "${spec#* }" > ${OUTPUT}/${name}.in
+    START=$(date +%s%N)
+    timeout ${BUDGET} ${ZUTTY} ${ZUTTY_OPTS} -headless ${OUTPUT}/${name}.in \
+            > ${OUTPUT}/${name}.out 2> ${OUTPUT}/${name}.log
+    RESULT=$?
+    MS=$((($(date +%s%N) - START) / 1000000))
+    if [ ${RESULT} -eq 124 ] ; then
+        printf "${name}: ${RED}FAIL${DFLT} (over budget of ${BUDGET} s)\n"
+        EXIT_CODE=1
+    elif [ ${RESULT} -ne 0 ] ; then
+        printf "${name}: ${RED}FAIL${DFLT} (see ${OUTPUT}/${name}.log)\n"
+        EXIT_CODE=1
+    else
+        printf "${name}: ${GREEN}OK${DFLT} ${MS} ms\n"
+    fi
+done
+
+exit ${EXIT_CODE}